@@ -0,0 +1,54 @@
+#pragma once
+#include "types.hpp"
+#include "move.hpp"
+#include "position.hpp"
+#include "search.hpp"
+#include <istream>
+#include <string>
+#include <vector>
+
+
+class ThreadPool;
+
+
+namespace Analysis
+{
+    struct Game
+    {
+        std::string name;
+        Position start;
+        std::vector<Move> moves;
+    };
+
+
+    // Scores are from the point of view of the side playing the move
+    struct MoveReport
+    {
+        Move played;
+        Move best;
+        Score played_score;
+        Score best_score;
+        Score loss;
+    };
+
+
+    struct GameReport
+    {
+        std::vector<MoveReport> moves;
+        uint64_t nodes;
+        double elapsed;
+    };
+
+
+    // Reads all games of a PGN stream, stopping at the first illegal move of each game
+    std::vector<Game> read_pgn(std::istream& stream);
+
+
+    GameReport analyze(ThreadPool& pool, const Game& game, const Search::Limits& limits);
+
+
+    std::string format(const Game& game, const GameReport& report);
+
+
+    void analyze_games(const std::vector<Game>& games, const Search::Limits& limits, int jobs);
+}
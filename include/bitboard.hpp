@@ -366,6 +366,7 @@ namespace Bitboards
     {
         int m_bits;
         uint64_t m_magic;
+        bool m_pext;
         Bitboard m_blockmask;
         std::vector<Bitboard> m_moveboards;
         int get_index(Bitboard blockboard) const;
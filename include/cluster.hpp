@@ -0,0 +1,77 @@
+#pragma once
+#include "types.hpp"
+#include "move.hpp"
+#include "position.hpp"
+#include "hash.hpp"
+#include "uci.hpp"
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Distributed Lazy SMP: hive processes connected over TCP search the same root and exchange their
+// deep TT writes. A coordinator drives the searches of its workers and plays the best result.
+namespace Cluster
+{
+    // TT write as exchanged between processes, in the native byte order: all members of a cluster
+    // must run on the same architecture
+    struct Entry
+    {
+        Hash hash;
+        Score score;
+        Score static_eval;
+        uint16_t move;
+        Depth depth;
+        uint8_t type;
+    };
+    static_assert(sizeof(Entry) == 16, "Cluster entries must be 16 bytes");
+
+
+    struct Result
+    {
+        Move bestmove;
+        Move ponder;
+        Score score;
+        Depth depth;
+    };
+
+
+    // Set while this process searches as part of a cluster
+    extern std::atomic_bool sharing;
+
+
+    void queue(const Entry& entry);
+
+
+    inline void share(Hash hash, Depth depth, Score score, Move best_move, EntryType type, Score static_eval)
+    {
+        if (depth >= UCI::Options::ClusterDepth && sharing.load(std::memory_order_relaxed))
+            queue(Entry{ hash, score, static_eval, static_cast<uint16_t>(best_move.to_int()), depth,
+                         static_cast<uint8_t>(type) });
+    }
+
+
+    // Coordinator: accepts workers in the background
+    bool listen(int port);
+
+    // Worker: serves the searches of a coordinator until it disconnects
+    bool join(const std::string& host, int port);
+
+    // Whether this process coordinates at least one worker
+    bool active();
+
+    // Coordinator: starts the workers on the same root, searching until finish_search
+    void start_search(const std::string& position, const std::vector<Move>& searchmoves);
+
+    // Coordinator: stops the workers and replaces the local result by a deeper one of a worker.
+    // Returns the index of the chosen worker, or -1 for the local result.
+    int finish_search(const Position& position, Result& best);
+
+    uint64_t remote_nodes();
+
+    void status(std::ostream& out);
+
+    void shutdown();
+}
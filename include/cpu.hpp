@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+
+// Hot kernels are compiled for several instruction sets, with the best one selected when the binary is loaded
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_MULTIVERSION)
+#define TARGET_CLONES __attribute__((target_clones("arch=x86-64-v3", "popcnt", "default")))
+#else
+#define TARGET_CLONES
+#endif
+
+
+namespace CPU
+{
+    struct Features
+    {
+        bool popcnt;
+        bool bmi2;
+        bool avx2;
+        bool fast_pext;
+    };
+
+
+    void init();
+
+
+    const Features& features();
+
+
+    std::string kernel_target();
+
+
+    std::string description();
+
+
+    // Computing resources available to the process: scheduler affinity, cgroup (v1 or v2) cpuset, CPU quota
+    // and memory limits, and the SMT topology of the allowed CPUs
+    struct Resources
+    {
+        int logical;
+        int cores;
+        double quota;
+        std::size_t memory_limit;
+        std::size_t physical_memory;
+    };
+
+
+    Resources resources();
+
+
+    std::string describe(const Resources& resources);
+
+
+    int auto_threads(const Resources& resources);
+
+
+    int auto_hash(const Resources& resources, int max_hash);
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "types.hpp"
 #include "position.hpp"
+#include <array>
 #include <iomanip>
 
 
@@ -137,6 +137,11 @@ public:
         return m_table[index(hash)].query(hash, entry_ptr);
     }
 
+    void prefetch(Hash hash) const
+    {
+        __builtin_prefetch(&m_table[index(hash)]);
+    }
+
     template<typename... Args>
     void store(Hash hash, Args... args)
     {
@@ -151,7 +156,7 @@ public:
         std::fill(m_table.begin(), m_table.end(), Entry());
     }
 
-    int max_size() const { return 262144; }
+    static int max_size() { return 262144; }
 
     void resize(std::size_t size_mb)
     {
@@ -163,8 +168,11 @@ public:
     {
         return m_full * 1000 / m_table.size();
     }
+
+    std::size_t size_mb() const { return mb_from_size(m_table.size()); }
+
+    std::size_t memory() const { return m_table.size() * sizeof(Entry); }
 };
 
 
-extern HashTable<TranspositionEntry> ttable;
 extern HashTable<PerftEntry> perft_table;
@@ -0,0 +1,123 @@
+#ifndef HIVE_H
+#define HIVE_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface to the hive engine, exported by libhive.a / libhive.so.
+ *
+ * Each engine owns its own search threads, transposition table and position, so several
+ * engines can live in the same process. Engine options not exposed here (MultiPV, SearchMode,
+ * ...) are process-wide and keep their UCI defaults.
+ *
+ * Unless stated otherwise, functions return 0 on success and a negative value on error.
+ */
+
+#if defined(_WIN32)
+#  define HIVE_API __declspec(dllexport)
+#else
+#  define HIVE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hive_engine hive_engine;
+
+
+/* Search bounds: zero means unbounded, but at least one bound must be set */
+typedef struct hive_limits
+{
+    int depth;
+    uint64_t nodes;
+    int movetime_ms;
+} hive_limits;
+
+
+typedef enum hive_bound
+{
+    HIVE_BOUND_EXACT = 0,
+    HIVE_BOUND_LOWER = 1,
+    HIVE_BOUND_UPPER = 2
+} hive_bound;
+
+
+/* Progress of a running search, reported on every completed (or failed) iteration */
+typedef struct hive_info
+{
+    int multipv;
+    int depth;
+    int seldepth;
+    int score_cp;       /* Side to move point of view, meaningless if mate != 0 */
+    int mate;           /* Mate in N moves (negative if being mated), 0 otherwise */
+    hive_bound bound;
+    uint64_t nodes;
+    double elapsed;     /* Seconds */
+    int hashfull;       /* Per mille */
+    const char* pv;     /* Space separated UCI moves, only valid during the callback */
+} hive_info;
+
+
+typedef void (*hive_info_callback)(const hive_info* info, void* user);
+
+
+typedef struct hive_result
+{
+    char bestmove[6];   /* UCI move, "0000" if the position has no legal moves */
+    char ponder[6];     /* UCI move, empty if none */
+    int score_cp;
+    int mate;
+    int depth;
+    uint64_t nodes;
+} hive_result;
+
+
+/*
+ * Packed positions: 37 bytes
+ *   [0, 32)  Board, one nibble per square from a1 to h8 (low nibble first): 0 is empty,
+ *            1-6 are white pawn, knight, bishop, rook, queen and king, 9-14 the black ones
+ *   32       Bit 0: side to move (1 for black), bits 1-4: castling rights KQkq
+ *   33       En passant square (0-63) or 255
+ *   34       Half-move clock
+ *   [35, 37) Full-move number, little endian
+ */
+#define HIVE_PACKED_SIZE 37
+
+
+/* Engine lifetime. Returns NULL on failure. */
+HIVE_API hive_engine* hive_create(int threads, int hash_mb);
+HIVE_API void hive_destroy(hive_engine* engine);
+
+/* Position setup */
+HIVE_API int hive_set_fen(hive_engine* engine, const char* fen);
+HIVE_API int hive_set_packed(hive_engine* engine, const uint8_t* packed, size_t size);
+HIVE_API int hive_play(hive_engine* engine, const char* uci_move);
+
+/* Static evaluation of the current position, in centipawns for the side to move */
+HIVE_API int hive_eval(hive_engine* engine);
+
+/*
+ * Searches the current position, blocking until a bound is hit or hive_stop is called from
+ * another thread. The callback (which may be NULL) runs on the search thread.
+ *
+ * hive_stop applies to any hive_search entered before it, even one that has not started
+ * searching yet (which then returns at once with the result of whatever it searched). Stop
+ * requests made before hive_search is entered are discarded.
+ */
+HIVE_API int hive_search(hive_engine* engine, const hive_limits* limits,
+                         hive_info_callback callback, void* user, hive_result* result);
+HIVE_API void hive_stop(hive_engine* engine);
+
+/* Number of leaf nodes at the given depth, split over the engine threads; negative on error or
+ * when interrupted by hive_stop */
+HIVE_API int64_t hive_perft(hive_engine* engine, int depth);
+
+/* Clears the transposition table */
+HIVE_API void hive_clear(hive_engine* engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
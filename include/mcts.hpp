@@ -0,0 +1,81 @@
+#pragma once
+#include "types.hpp"
+#include "move.hpp"
+#include "position.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class Thread;
+
+namespace Search
+{
+    enum class NodeState : uint8_t
+    {
+        UNEXPANDED,
+        EXPANDING,
+        EXPANDED,
+        TERMINAL
+    };
+
+
+    class MCTSNode
+    {
+    public:
+        Move move;
+        float prior;
+        std::atomic<NodeState> state;
+        std::atomic_int n_children;
+        std::atomic<MCTSNode*> children;
+        std::atomic_int visits;
+        std::atomic_int virtual_loss;
+        std::atomic_int64_t value;
+
+        MCTSNode();
+
+        void reset(Move move, float prior);
+
+        double q(double default_q) const;
+    };
+
+
+    class MCTSTree
+    {
+        // Nodes are allocated in blocks owned by each thread, so that expansions never contend
+        struct Arena
+        {
+            std::vector<std::unique_ptr<MCTSNode[]>> blocks;
+            int current;
+            int used;
+        };
+
+        MCTSNode m_root;
+        std::vector<Arena> m_arenas;
+        std::size_t m_max_nodes;
+        std::atomic_size_t m_n_nodes;
+        std::atomic_uint64_t m_iterations;
+        std::atomic_uint64_t m_depth_sum;
+        std::atomic_int m_max_depth;
+
+        MCTSNode* allocate(int thread_id, int n_nodes);
+
+        MCTSNode* select(const MCTSNode* node) const;
+
+        void expand(MCTSNode* node, Position& position, Thread& thread, Depth ply);
+
+        bool iteration(Position& position, Thread& thread);
+
+        void update_pvs(Thread& thread, int n_pvs) const;
+
+    public:
+        MCTSTree();
+
+        void clear(int n_threads, std::size_t size_mb);
+
+        void search(Position& position, Thread& thread, int n_pvs);
+
+        uint64_t iterations() const;
+
+        std::size_t memory() const;
+    };
+}
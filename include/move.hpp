@@ -260,4 +260,9 @@ public:
         m_current--;
         return *this;
     }
+
+    std::size_t memory() const
+    {
+        return NUM_MAX_MOVES * m_depth * sizeof(Move);
+    }
 };
@@ -63,16 +63,17 @@ class MoveOrder
     Move m_killer;
     Move* m_curr;
 
+    template<Turn TURN>
     bool hash_move(Move& move);
 
 
-    template<bool CAPTURES>
+    template<Turn TURN, bool CAPTURES>
     int move_score(Move move) const
     {
         if (CAPTURES)
             return capture_score(move);
         else
-            return quiet_score(move);
+            return quiet_score<TURN>(move);
     }
 
 
@@ -86,13 +87,13 @@ class MoveOrder
     }
 
 
-    template<bool CAPTURES>
+    template<Turn TURN, bool CAPTURES>
     MoveList threshold_moves(MoveList& list, int threshold)
     {
         Move* pos = list.begin();
         for (auto list_move = list.begin(); list_move != list.end(); list_move++)
         {
-            if (move_score<CAPTURES>(*list_move) > threshold)
+            if (move_score<TURN, CAPTURES>(*list_move) > threshold)
             {
                 if (pos != list_move)
                     std::swap(*pos, *list_move);
@@ -104,12 +105,12 @@ class MoveOrder
     }
 
 
-    template<bool CAPTURES>
+    template<Turn TURN, bool CAPTURES>
     void sort_moves(MoveList list) const
     {
         std::sort(list.begin(), list.end(), [this](Move a, Move b)
                   {
-                      return move_score<CAPTURES>(a) > move_score<CAPTURES>(b);
+                      return move_score<TURN, CAPTURES>(a) > move_score<TURN, CAPTURES>(b);
                   });
     }
 
@@ -119,6 +120,20 @@ public:
 
     Move next_move();
 
+    template<Turn TURN>
+    Move next_move();
+
     int capture_score(Move move) const;
     int quiet_score(Move move) const;
+
+    template<Turn TURN>
+    int quiet_score(Move move) const
+    {
+        // Quiets are scored based on:
+        // 1. Butterfly histories
+        // 2. Piece type-destination histories
+        PieceType piece = m_position.board().get_piece_at(move.from());
+        return m_histories.butterfly_score(move, TURN)
+             + m_histories.piece_type_score(move, piece);
+    }
 };
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+namespace Perf
+{
+    enum Event
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        LLC_MISSES,
+        DTLB_MISSES,
+        NUM_EVENTS
+    };
+
+
+    struct Sample
+    {
+        uint64_t values[NUM_EVENTS];
+        bool valid[NUM_EVENTS];
+
+        Sample();
+
+        bool empty() const;
+
+        Sample& operator+=(const Sample& other);
+    };
+
+
+    // Hardware counters of the calling thread. Events that cannot be opened (no PMU access,
+    // containers, non-Linux systems) are silently left out of the samples.
+    class Counters
+    {
+        int m_fd[NUM_EVENTS];
+        bool m_opened;
+
+    public:
+        Counters();
+        ~Counters();
+
+        Counters(const Counters&) = delete;
+        Counters& operator=(const Counters&) = delete;
+
+        bool start();
+
+        void stop();
+
+        Sample read() const;
+    };
+
+
+    std::string unavailable_reason();
+
+
+    std::string report(const Sample& sample, uint64_t nodes, double elapsed);
+}
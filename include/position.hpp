@@ -32,6 +32,10 @@ class Board
     uint8_t m_phase;
     Piece m_board_pieces[NUM_SQUARES];
 
+    // Lazily computed fields
+    mutable Bitboard m_threats[NUM_COLORS];
+    mutable bool m_threats_valid[NUM_COLORS];
+
 protected:
 
     template<Turn TURN, PieceType PIECE_TYPE>
@@ -159,16 +163,14 @@ protected:
     template<Turn TURN>
     void generate_moves_king(MoveList& list, Bitboard filter, Bitboard occupancy) const
     {
+        // Only squares not attacked by the opponent
         Square king_square = get_pieces<TURN, KING>().bitscan_forward();
-        Bitboard attacks = Bitboards::get_attacks<KING>(king_square, occupancy) & filter;
-        Bitboard occupancy_noking = occupancy ^ get_pieces<TURN, KING>();
+        Bitboard attacks = Bitboards::get_attacks<KING>(king_square, occupancy) & filter & ~threats<~TURN>();
 
         while (attacks)
         {
-            // Test if target square is attacked
             Square target = attacks.bitscan_forward_reset();
-            if (!attackers<~TURN>(target, occupancy_noking))
-                list.push(king_square, target, occupancy.test(target) ? CAPTURE : QUIET);
+            list.push(king_square, target, occupancy.test(target) ? CAPTURE : QUIET);
         }
 
         // Castling when not in check
@@ -183,56 +185,6 @@ protected:
     }
 
 
-    template<Turn TURN>
-    void generate_moves(MoveList& list, MoveGenType type) const
-    {
-        Bitboard occupancy = get_pieces();
-        Square king_square = get_pieces<TURN, KING>().bitscan_forward();
-        Bitboard pinners;
-        Bitboard pinned = pins<TURN>(king_square, occupancy, pinners);
-
-        Bitboard filter;
-        if (type == MoveGenType::LEGAL)
-            filter = ~get_pieces<TURN>();
-        else if (type == MoveGenType::QUIETS)
-            filter = ~occupancy;
-        else if (type == MoveGenType::CAPTURES)
-            filter = get_pieces<~TURN>();
-
-        // Not a double check
-        if (!checkers().more_than_one())
-        {
-            Bitboard new_filter = filter;
-            if (checkers())
-                new_filter &= (checkers() | Bitboards::between(king_square, checkers().bitscan_forward()));
-
-            // Moves for each piece type (except king)
-            generate_moves_pawns<TURN  >(list, new_filter, occupancy);
-            generate_moves<TURN, KNIGHT>(list, new_filter, occupancy);
-            generate_moves<TURN, BISHOP>(list, new_filter, occupancy);
-            generate_moves<TURN, ROOK  >(list, new_filter, occupancy);
-            generate_moves<TURN, QUEEN >(list, new_filter, occupancy);
-        }
-
-        // King moves: always legal
-        generate_moves_king<TURN>(list, filter, occupancy);
-
-        // Check for pins
-        if (pinned)
-        {
-            auto move = list.begin();
-            // Iterate list and pop the move if:
-            // 1. Piece is pinned
-            // 2. The piece can't move to the destination without breaking the pin (or capturing the pinner)
-            while (move != list.end())
-                if (pinned.test(move->from()) && !test_pinned_move<TURN>(move->from(), move->to(), pinners, king_square))
-                    list.pop(move);
-                else
-                    move++;
-        }
-    }
-
-
     template<Turn TURN>
     bool test_pinned_move(Square pinned, Square target, Bitboard pinners, Square king_square) const
     {
@@ -404,11 +356,10 @@ protected:
         }
         else if (PIECE_TYPE == KING)
         {
-            Bitboard occupancy_noking = occupancy ^ get_pieces<TURN, KING>();
             Bitboard attacks = Bitboards::get_attacks<PIECE_TYPE>(move.from(), occupancy);
             // If move pseudolegal, return whether the target square is attacked or not
             if (!move.is_castle() && attacks.test(move.to()))
-                return !attackers<~TURN>(move.to(), occupancy_noking);
+                return !threats<~TURN>().test(move.to());
 
             // Castling test
             if (!checkers() && move.is_castle())
@@ -444,15 +395,6 @@ protected:
     }
 
 
-    template<PieceType PIECE_TYPE>
-    bool legal(Move move, Bitboard occupancy) const
-    {
-        if (m_turn == WHITE)
-            return legal<WHITE, PIECE_TYPE>(move, occupancy);
-        else
-            return legal<BLACK, PIECE_TYPE>(move, occupancy);
-    }
-
 public:
     Board();
 
@@ -468,6 +410,8 @@ public:
 
     Board make_move(Move move) const;
 
+    Hash hash_after(Move move) const;
+
 
     Board make_null_move();
 
@@ -478,6 +422,56 @@ public:
     void generate_moves(MoveList& list, MoveGenType type) const;
 
 
+    template<Turn TURN>
+    void generate_moves(MoveList& list, MoveGenType type) const
+    {
+        Bitboard occupancy = get_pieces();
+        Square king_square = get_pieces<TURN, KING>().bitscan_forward();
+        Bitboard pinners;
+        Bitboard pinned = pins<TURN>(king_square, occupancy, pinners);
+
+        Bitboard filter;
+        if (type == MoveGenType::LEGAL)
+            filter = ~get_pieces<TURN>();
+        else if (type == MoveGenType::QUIETS)
+            filter = ~occupancy;
+        else if (type == MoveGenType::CAPTURES)
+            filter = get_pieces<~TURN>();
+
+        // Not a double check
+        if (!checkers().more_than_one())
+        {
+            Bitboard new_filter = filter;
+            if (checkers())
+                new_filter &= (checkers() | Bitboards::between(king_square, checkers().bitscan_forward()));
+
+            // Moves for each piece type (except king)
+            generate_moves_pawns<TURN  >(list, new_filter, occupancy);
+            generate_moves<TURN, KNIGHT>(list, new_filter, occupancy);
+            generate_moves<TURN, BISHOP>(list, new_filter, occupancy);
+            generate_moves<TURN, ROOK  >(list, new_filter, occupancy);
+            generate_moves<TURN, QUEEN >(list, new_filter, occupancy);
+        }
+
+        // King moves: always legal
+        generate_moves_king<TURN>(list, filter, occupancy);
+
+        // Check for pins
+        if (pinned)
+        {
+            auto move = list.begin();
+            // Iterate list and pop the move if:
+            // 1. Piece is pinned
+            // 2. The piece can't move to the destination without breaking the pin (or capturing the pinner)
+            while (move != list.end())
+                if (pinned.test(move->from()) && !test_pinned_move<TURN>(move->from(), move->to(), pinners, king_square))
+                    list.pop(move);
+                else
+                    move++;
+        }
+    }
+
+
     inline PieceType get_piece_at(Square square) const
     {
         return get_piece_type(m_board_pieces[square]);
@@ -586,13 +580,35 @@ public:
         if (occupancy & Bitboards::castle_non_occupied_squares[TURN][side])
             return false;
 
-        // Check if middle squares are attacked
-        Bitboard attackable = Bitboards::castle_non_attacked_squares[TURN][side];
-        while (attackable)
-            if (attackers<~TURN>(attackable.bitscan_forward_reset(), occupancy))
-                return false;
+        // Check if middle squares are attacked (removing the king from the occupancy makes no difference when not in check)
+        return !(threats<~TURN>() & Bitboards::castle_non_attacked_squares[TURN][side]);
+    }
+
 
-        return true;
+    template<Turn TURN>
+    Bitboard threats() const
+    {
+        // Squares attacked by TURN, computed once per board with the enemy king removed from the occupancy
+        if (!m_threats_valid[TURN])
+        {
+            Bitboard occupancy = get_pieces() ^ get_pieces<~TURN, KING>();
+            Bitboard result = Bitboards::get_attacks_pawns<TURN>(get_pieces<TURN, PAWN>())
+                            | Bitboards::get_attacks<KING>(get_pieces<TURN, KING>().bitscan_forward(), occupancy);
+
+            Bitboard b = get_pieces<TURN, KNIGHT>();
+            while (b)
+                result |= Bitboards::get_attacks<KNIGHT>(b.bitscan_forward_reset(), occupancy);
+            b = get_pieces<TURN, BISHOP>() | get_pieces<TURN, QUEEN>();
+            while (b)
+                result |= Bitboards::get_attacks<BISHOP>(b.bitscan_forward_reset(), occupancy);
+            b = get_pieces<TURN, ROOK>() | get_pieces<TURN, QUEEN>();
+            while (b)
+                result |= Bitboards::get_attacks<ROOK>(b.bitscan_forward_reset(), occupancy);
+
+            m_threats[TURN] = result;
+            m_threats_valid[TURN] = true;
+        }
+        return m_threats[TURN];
     }
 
 
@@ -608,6 +624,10 @@ public:
     Score see(Move move, int threshold = 0) const;
 
 
+    template<Turn TURN>
+    Score see(Move move, int threshold = 0) const;
+
+
     MixedScore material_eval() const;
 
 
@@ -617,12 +637,24 @@ public:
     bool legal(Move move) const;
 
 
+    template<Turn TURN>
+    bool legal(Move move) const;
+
+
     Bitboard non_pawn_material() const;
 
 
     Bitboard non_pawn_material(Turn turn) const;
 
 
+    template<Turn TURN>
+    Bitboard non_pawn_material() const
+    {
+        return get_pieces<TURN, KNIGHT>() | get_pieces<TURN, BISHOP>()
+             | get_pieces<TURN, ROOK  >() | get_pieces<TURN, QUEEN >();
+    }
+
+
     Bitboard sliders() const;
 };
 
@@ -655,6 +687,9 @@ public:
     bool is_draw(bool unique) const;
 
 
+    bool repeats(Hash hash) const;
+
+
     bool in_check() const;
 
 
@@ -698,6 +733,18 @@ public:
 
 
     bool reduced() const;
+
+
+    bool same_state(const Position& other) const;
+
+
+    Move last_move() const;
+
+
+    std::size_t memory() const;
+
+
+    static constexpr std::size_t memory_per_ply() { return sizeof(Board) + sizeof(MoveInfo); }
 };
 
 
@@ -5,6 +5,7 @@
 #include "hash.hpp"
 #include "move_order.hpp"
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -12,6 +13,7 @@
 #include <condition_variable>
 
 class Thread;
+class ThreadPool;
 
 namespace Search
 {
@@ -72,10 +74,18 @@ namespace Search
         uint64_t m_movetime_ms;
         std::atomic_bool m_pondering;
         std::atomic<std::chrono::steady_clock::time_point> m_end_time;
+        int m_nodes_per_ms;
+        std::function<uint64_t()> m_nodes;
+        std::atomic<double> m_end_nodes_ms;
+
+        double nodes_ms() const;
 
     public:
         SearchTime() noexcept;
 
+        // With a positive rate, managed time is measured in nodes instead of wall-clock time
+        void set_nodes_time(int nodes_per_ms, std::function<uint64_t()> nodes);
+
         void init(const Timer& timer, bool ponder);
         void init(const Timer& timer, uint64_t movetime_ms, bool ponder);
 
@@ -85,12 +95,35 @@ namespace Search
 
         double elapsed() const;
 
+        double used() const;
+
         double remaining() const;
 
         bool time_management() const;
     };
 
 
+    // Counters of the selective search, kept per thread and summed over the pool
+    struct SearchStats
+    {
+        uint64_t probcut_nodes;
+        uint64_t probcut_captures;
+        uint64_t probcut_cutoffs;
+        uint64_t etc_nodes;
+        uint64_t etc_probes;
+        uint64_t etc_cutoffs;
+        uint64_t qsearch_nodes;
+        uint64_t qsearch_ply_cutoffs;
+        uint64_t qsearch_limited_evasions;
+        Depth qsearch_max_ply;
+        Depth qsearch_max_checks;
+
+        SearchStats();
+
+        SearchStats& operator+=(const SearchStats& other);
+    };
+
+
     enum class BoundType
     {
         LOWER_BOUND,
@@ -110,7 +143,7 @@ namespace Search
     
         MultiPVData();
 
-        void write_pv(int index, uint64_t nodes, double elapsed) const;
+        void write_pv(int index, uint64_t nodes, double elapsed, int hashfull) const;
     };
 
 
@@ -134,7 +167,7 @@ namespace Search
         bool m_isPv;
 
     public:
-        SearchData(Thread& thread);
+        SearchData(Thread& thread, int ply = 0, Move last_move = MOVE_NULL);
 
         SearchData next(Move move, int extension = 0) const;
 
@@ -142,6 +175,8 @@ namespace Search
         Score static_eval;
         Move excluded_move;
         Histories& histories;
+        int qsearch_ply;
+        int qsearch_checks;
 
         int ply() const;
         int extensions() const;
@@ -167,20 +202,30 @@ namespace Search
     Score aspiration_search(Position& position, MultiPVData& pv, Depth depth, SearchData& data);
 
 
+    Score mtdf_search(Position& position, MultiPVData& pv, Depth depth, SearchData& data);
+
+
+    Score full_window_search(Position& position, MultiPVData& pv, Depth depth, SearchData& data);
+
+
     Score iter_deepening(Position& position, SearchData& data);
 
 
-    template<SearchType ST>
+    template<SearchType ST, Turn TURN>
     Score negamax(Position& position, Depth depth, Score alpha, Score beta, SearchData& data);
 
 
-    template<SearchType ST>
+    template<SearchType ST, Turn TURN>
     Score quiescence(Position& position, Score alpha, Score beta, SearchData& data);
 
 
     bool legality_tests(Position& position, MoveList& move_list);
 
 
+    // Perft split over the root moves on the pool threads, -1 if interrupted by a stop
+    int64_t parallel_perft(ThreadPool& pool, const Position& position, Depth depth, bool output);
+
+
     template<bool OUTPUT, bool USE_ORDER = false, bool TT = false, bool LEGALITY = false>
     int64_t perft(Position& position, Depth depth)
     {
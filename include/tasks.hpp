@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+
+namespace Tasks
+{
+    class WaitGroup
+    {
+        std::atomic_int m_pending;
+
+    public:
+        WaitGroup();
+
+        void add(int count = 1);
+
+        void done();
+
+        bool finished() const;
+    };
+
+
+    struct Task
+    {
+        std::function<void()> function;
+        WaitGroup* group;
+    };
+
+
+    // Chase-Lev work-stealing deque with a fixed capacity. The owner pushes and pops at the bottom,
+    // any other thread steals from the top.
+    class Deque
+    {
+        static constexpr int64_t CAPACITY = 1024;
+
+        std::atomic<int64_t> m_top;
+        std::atomic<int64_t> m_bottom;
+        std::array<std::atomic<Task*>, CAPACITY> m_tasks;
+
+    public:
+        Deque();
+
+        // Owner only: returns false when the deque is full
+        bool push(Task* task);
+
+        // Owner only
+        Task* pop();
+
+        Task* steal();
+    };
+}
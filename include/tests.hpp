@@ -68,4 +68,31 @@ namespace Tests
 
 
     int legality_tests();
+
+
+    int threat_tests();
+
+
+    int hash_tests();
+
+
+    int task_tests();
+
+
+    int search_tests();
+
+
+    int qsearch_tests();
+
+
+    int analysis_tests();
+
+
+    std::vector<std::string> bench_suite();
+
+
+    void bench(int depth);
+
+
+    void scaling(int movetime, int max_threads);
 }
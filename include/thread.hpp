@@ -4,18 +4,26 @@
 #include "hash.hpp"
 #include "move_order.hpp"
 #include "search.hpp"
+#include "mcts.hpp"
+#include "perf.hpp"
+#include "treelog.hpp"
+#include "tasks.hpp"
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
 
 
 enum class ThreadStatus
 {
     WAITING,
     SEARCHING,
+    WORKING,
     QUITTING
 };
 
@@ -36,16 +44,37 @@ class Thread
 
     void thread_loop();
 
+    void generate_root_moves(Move* moves);
+
     void search();
 
+    void iterative_deepening(int n_pvs);
+
+    void resume(int n_pvs);
+
+    void split_search(Move* moves);
+
+    void run_tasks();
+
 protected:
     friend class Search::SearchData;
+    friend class Search::MCTSTree;
     friend class ThreadPool;
     Depth m_seldepth;
     Search::PvContainer m_pv;
     Histories m_histories;
+    HashTable<TranspositionEntry> m_qtable;
+    Perf::Counters m_counters;
+    TreeLog::Writer m_tree_log;
+    Search::SearchStats m_stats;
     std::atomic_uint64_t m_nodes_searched;
     std::vector<Search::MultiPVData> m_multiPV;
+    Depth m_completed_depth;
+    std::vector<Search::MultiPVData> m_completed_pvs;
+    int m_group;
+    bool m_resume;
+    std::atomic_bool m_regroup;
+    Tasks::Deque m_tasks;
 
 public:
     Thread(int id, ThreadPool& pool);
@@ -58,15 +87,35 @@ public:
 
     bool timeout() const;
 
+    bool parked() const;
+
     void wake(ThreadStatus status);
 
+    void wake_idle(ThreadStatus status);
+
     void wait();
 
     int id() const;
+    int group() const;
+    TreeLog::Writer& tree_log();
+    Search::SearchStats& stats();
     bool is_main() const;
     ThreadPool& pool() const;
     const Search::Limits& limits() const;
     const Search::SearchTime& time() const;
+    HashTable<TranspositionEntry>& qsearch_table();
+
+    bool resize_qtable();
+
+    std::size_t memory() const;
+};
+
+
+// Receivers of the search output. When unset, the output is written to stdout in UCI format
+struct SearchListeners
+{
+    std::function<void(int index, const Search::MultiPVData& pv, uint64_t nodes, double elapsed, int hashfull)> info;
+    std::function<void(Move bestmove, Move ponder)> bestmove;
 };
 
 
@@ -77,14 +126,72 @@ class ThreadPool
 
     void send_signal(ThreadStatus signal);
 
+    void assign_roots(bool ponder);
+
+    void finish_tree_log();
+
+    bool wait_helper(const Thread& thread);
+
+    void update_helpers(Depth depth, Move best_move, Score score);
+
+    bool next_split_job(Depth& depth, int& index, Search::MultiPVData& pv);
+
+    void store_split_result(int index, const Search::MultiPVData& pv);
+
+    void wait_split(const Thread& thread);
+
+    void close_split(std::vector<Search::MultiPVData>& pvs);
+
+    Tasks::Task* find_task(int first);
+
+    void execute(Tasks::Task* task);
+
 protected:
     friend class Thread;
     Search::Limits m_limits;
     Search::SearchTime m_time;
+    Search::MCTSTree m_tree;
+    HashTable<TranspositionEntry> m_tt;
+    std::size_t m_qtable_mb;
+    std::size_t m_tree_mb;
+    SearchListeners m_listeners;
+    std::vector<Position> m_roots;
+    int m_last_multiPV;
+    bool m_resumable;
+    int64_t m_available_nodes;
+    std::atomic_int64_t m_ponderhit_nodes;
+    TreeLog::File m_tree_file;
+    std::string m_tree_path;
+    Depth m_tree_depth;
+    int m_tree_ply;
+    std::atomic_uint32_t m_root_score;
     std::atomic<ThreadStatus> m_status;
+    std::mutex m_park_mutex;
+    std::condition_variable m_park_cvar;
+    std::atomic_bool m_helpers_parked;
+    bool m_park_at_start;
+    bool m_forced_move;
+    std::chrono::steady_clock::time_point m_park_deadline;
+    Move m_stable_move;
+    Score m_stable_score;
+    int m_stable_iterations;
+    bool m_split;
+    std::vector<Move> m_split_moves;
+    std::atomic_int m_split_next;
+    std::mutex m_split_mutex;
+    std::condition_variable m_split_cvar;
+    std::vector<std::vector<Search::MultiPVData>> m_split_results;
+    std::vector<int> m_split_done;
+    Depth m_split_depth;
+    std::vector<Search::MultiPVData> m_split_pvs;
+    bool m_split_closed;
+    std::mutex m_task_mutex;
+    std::deque<Tasks::Task*> m_injected_tasks;
+    std::atomic_int m_pending_tasks;
 
 public:
     ThreadPool();
+    ~ThreadPool();
 
     void resize(int n_threads);
 
@@ -96,19 +203,60 @@ public:
 
     void kill_threads();
 
+    void clear();
+
     void ponderhit();
 
     bool pondering() const;
 
     void update_time(const Search::Timer& timer, const Search::Limits& limits);
 
+    void report_counters();
+
     const std::atomic<ThreadStatus>& status() const;
 
     Position& position();
     Position position() const;
+
+    HashTable<TranspositionEntry>& tt();
+
+    void set_memory(std::size_t tt_mb, std::size_t qtable_mb, std::size_t tree_mb);
+
+    std::size_t thread_memory() const;
+
+    std::size_t qtable_mb() const;
+    std::size_t tree_mb() const;
+
+    std::size_t memory() const;
+
+    void set_listeners(const SearchListeners& listeners);
+
+    void log_next_search(const std::string& path, Depth max_depth, int max_ply);
+
+    void publish_root_score(Depth depth, Score score);
+
+    bool shared_root_score(Depth min_depth, Score& score) const;
+
+    bool has_listeners() const;
+
+    // Root move partitioning: the root moves of the search are split over the threads
+    bool root_split() const;
+
+    // Task layer on the search threads, for jobs other than searches. Tasks submitted during a
+    // search run inline on the caller; long tasks should poll cancelled() to honour stop().
+    void submit(std::function<void()> task, Tasks::WaitGroup& group);
+
+    void wait_group(Tasks::WaitGroup& group);
+
+    // Returns false if stop() interrupted the loop
+    bool parallel_for(int begin, int end, const std::function<void(int)>& body);
+
+    bool cancelled() const;
     
     int64_t nodes_searched() const;
 
+    Search::SearchStats stats() const;
+
     int size() const;
 
     void wait();
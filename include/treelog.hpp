@@ -0,0 +1,127 @@
+#pragma once
+#include "types.hpp"
+#include "move.hpp"
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace TreeLog
+{
+    enum Event : uint8_t
+    {
+        // Node exits, recorded with the score returned by the node
+        NODE,
+        TT_CUTOFF,
+        MATE_DISTANCE,
+        DRAW,
+        FUTILITY,
+        NULL_MOVE,
+        MULTI_CUT,
+        PROBCUT,
+        ETC,
+
+        // Moves of a node, recorded with the move
+        PRUNE_SEE_CAPTURE,
+        PRUNE_MOVE_COUNT,
+        PRUNE_HISTORY,
+        PRUNE_SEE_QUIET,
+        SINGULAR_EXTENSION,
+        LMR,
+        LMR_RESEARCH,
+        PVS_RESEARCH,
+
+        NUM_EVENTS
+    };
+
+
+    enum Flags : uint8_t
+    {
+        TT_HIT = 1,
+        IN_CHECK = 2,
+        EXCLUDED_MOVE = 4
+    };
+
+
+    // Fixed-size record, written as-is in the native byte order
+    struct Record
+    {
+        uint16_t move;
+        Score alpha;
+        Score beta;
+        Score score;
+        uint8_t ply;
+        Depth depth;
+        Depth iteration;
+        uint8_t thread;
+        uint8_t node_type;
+        uint8_t event;
+        uint8_t flags;
+        uint8_t reserved;
+    };
+    static_assert(sizeof(Record) == 16, "Tree log records must be 16 bytes");
+
+
+    // Output file of a logged search, shared by all threads
+    class File
+    {
+        std::ofstream m_stream;
+        std::mutex m_mutex;
+        uint64_t m_records;
+
+    public:
+        File();
+
+        bool open(const std::string& path);
+
+        bool is_open() const;
+
+        void write(const Record* records, std::size_t count);
+
+        uint64_t close();
+    };
+
+
+    // Per-thread record buffer, flushed to the shared file when full and at the end of the search
+    class Writer
+    {
+        static constexpr std::size_t BUFFER_SIZE = 4096;
+
+        File* m_file;
+        std::vector<Record> m_buffer;
+        uint8_t m_thread;
+        int m_max_ply;
+        Depth m_max_depth;
+        Depth m_iteration;
+
+    public:
+        Writer();
+
+        void start(File* file, int thread, Depth max_depth, int max_ply);
+
+        void set_iteration(Depth iteration) { m_iteration = iteration; }
+
+        bool enabled(int ply) const { return m_file && ply <= m_max_ply && m_iteration <= m_max_depth; }
+
+        void write(Event event, int ply, Move move, int node_type, Depth depth,
+                   Score alpha, Score beta, Score score, uint8_t flags)
+        {
+            m_buffer.push_back(Record{ static_cast<uint16_t>(move.to_int()), alpha, beta, score,
+                                       static_cast<uint8_t>(ply), depth, m_iteration, m_thread,
+                                       static_cast<uint8_t>(node_type), event, flags, 0 });
+            if (m_buffer.size() >= BUFFER_SIZE)
+                flush();
+        }
+
+        void flush();
+
+        void stop();
+    };
+
+
+    // Aggregates a log file: node exits and move decisions per remaining depth, and re-search rates
+    bool report(const std::string& path, std::ostream& out);
+}
@@ -34,6 +34,8 @@ namespace UCI
         int m_max;
         std::vector<std::string> m_var;
         std::variant<OnChange<>, OnChange<bool>, OnChange<int>, OnChange<std::string>> m_change;
+        std::function<int()> m_automatic;
+        bool m_is_auto = false;
 
     public:
         Option(bool* data, bool def, OnChange<bool> change = nullptr)
@@ -41,8 +43,8 @@ namespace UCI
         {
             *data = def;
         }
-        Option(int* data, int def, int min, int max, OnChange<int> change = nullptr)
-            : m_type(SPIN), m_data(data), m_default(def), m_min(min), m_max(max), m_change(change)
+        Option(int* data, int def, int min, int max, OnChange<int> change = nullptr, std::function<int()> automatic = nullptr)
+            : m_type(SPIN), m_data(data), m_default(def), m_min(min), m_max(max), m_change(change), m_automatic(automatic)
         {
             *data = def;
         }
@@ -62,6 +64,8 @@ namespace UCI
 
         void set(std::string value);
 
+        void refresh();
+
         template<typename T>
         auto get() const { return std::get<T>(m_data); }
 
@@ -76,15 +80,39 @@ namespace UCI
     namespace Options
     {
         extern int Hash;
+        extern int Memory;
         extern int MultiPV;
         extern bool Ponder;
         extern int Threads;
+        extern std::string SearchMode;
+        extern std::string RootSearch;
+        extern bool QSearchHash;
+        extern int QSearchPlies;
+        extern int QSearchChecks;
+        extern bool QSearchInfo;
+        extern bool ParallelAspiration;
+        extern int MultiPonder;
+        extern int NodesTime;
+        extern int HelperDepth;
+        extern int HelperTime;
+        extern int HelperStable;
+        extern bool RootSplit;
+        extern int ClusterDepth;
+        extern bool ProbCut;
+        extern bool ETC;
+        extern bool LMRHistory;
+        extern bool LMRImproving;
+        extern bool LMRNodeType;
+        extern bool PerfCounters;
     }
 
 
     void init_options();
 
 
+    void update_memory();
+
+
     void main_loop();
     void setoption(Stream& stream);
     void uci(Stream& stream);
@@ -95,7 +123,11 @@ namespace UCI
     void ponderhit(Stream& stream);
     void ucinewgame(Stream& stream);
     void isready(Stream& stream);
+    void analyzegame(Stream& stream);
 
 
     Move move_from_uci(Position& position, std::string move_str);
+
+
+    Move move_from_san(Position& position, std::string move_str);
 }
@@ -0,0 +1,305 @@
+#include "../include/analysis.hpp"
+#include "../include/types.hpp"
+#include "../include/position.hpp"
+#include "../include/search.hpp"
+#include "../include/thread.hpp"
+#include "../include/uci.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+
+namespace Analysis
+{
+    // Losses are measured on scores capped at this value, so that missed mates or blunders in
+    // already decided positions do not dominate the averages
+    constexpr Score LOSS_CAP = 1000;
+
+
+    std::string score_string(Score score)
+    {
+        if (is_mate(score))
+            return (score > 0 ? "M" : "-M") + std::to_string(std::abs(mate_in(score)));
+        return std::to_string(score);
+    }
+
+
+    Score capped(Score score)
+    {
+        return std::clamp(static_cast<int>(score), -static_cast<int>(LOSS_CAP), static_cast<int>(LOSS_CAP));
+    }
+
+
+    bool is_result(const std::string& token)
+    {
+        return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+    }
+
+
+
+    std::vector<Game> read_pgn(std::istream& stream)
+    {
+        std::vector<Game> games;
+        Game game{ "", Position(), {} };
+        Position position;
+        bool broken = false;
+        int comment_depth = 0;
+        int variation_depth = 0;
+
+        auto finish_game = [&]()
+        {
+            if (!game.moves.empty())
+            {
+                if (game.name.empty())
+                    game.name = "game " + std::to_string(games.size() + 1);
+                games.push_back(game);
+            }
+            game = Game{ "", Position(), {} };
+            position = Position();
+            broken = false;
+        };
+
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            // Tag pairs: a tag after the movetext starts a new game
+            if (comment_depth == 0 && !line.empty() && line[0] == '[')
+            {
+                if (!game.moves.empty() || broken)
+                    finish_game();
+
+                std::size_t quote = line.find('"');
+                std::size_t end = line.rfind('"');
+                if (quote == std::string::npos || end <= quote)
+                    continue;
+                std::string tag = line.substr(1, line.find(' ') - 1);
+                std::string value = line.substr(quote + 1, end - quote - 1);
+                if (tag == "FEN")
+                {
+                    game.start = Position(value);
+                    position = game.start;
+                }
+                else if (tag == "White")
+                    game.name = value + game.name;
+                else if (tag == "Black")
+                    game.name += " - " + value;
+                continue;
+            }
+
+            // Movetext: skip comments, variations and numeric annotation glyphs
+            std::string token;
+            auto process_token = [&]()
+            {
+                // Move numbers may be glued to the move ("12.e4")
+                std::size_t start = token.find_first_not_of("0123456789.");
+                if (is_result(token))
+                    finish_game();
+                else if (start != std::string::npos && token[0] != '$' && !broken)
+                {
+                    Move move = UCI::move_from_san(position, token.substr(start));
+                    if (move == MOVE_NULL)
+                        broken = true;
+                    else
+                    {
+                        game.moves.push_back(move);
+                        position.make_move(move);
+                        position.set_init_ply();
+                    }
+                }
+                token.clear();
+            };
+
+            for (char c : line + " ")
+            {
+                if (comment_depth > 0)
+                    comment_depth -= (c == '}');
+                else if (c == '{')
+                    comment_depth++;
+                else if (c == ';' && variation_depth == 0)
+                    break;
+                else if (c == '(')
+                    variation_depth++;
+                else if (c == ')')
+                    variation_depth = std::max(0, variation_depth - 1);
+                else if (variation_depth > 0)
+                    continue;
+                else if (std::isspace(static_cast<unsigned char>(c)))
+                {
+                    if (!token.empty())
+                        process_token();
+                }
+                else
+                    token += c;
+            }
+            if (!token.empty())
+                process_token();
+        }
+
+        finish_game();
+        return games;
+    }
+
+
+
+    GameReport analyze(ThreadPool& pool, const Game& game, const Search::Limits& limits)
+    {
+        GameReport report{ {}, 0, 0 };
+        Search::Timer timer;
+
+        std::vector<Position> positions(1, game.start);
+        for (Move move : game.moves)
+        {
+            Position next = positions.back();
+            next.make_move(move);
+            next.set_init_ply();
+            positions.push_back(next);
+        }
+
+        // Walk the game backwards: each search then finds the TT entries left by the later positions,
+        // which are mostly subtrees of the current one
+        std::vector<Score> scores(positions.size(), SCORE_DRAW);
+        std::vector<Move> best_moves(positions.size(), MOVE_NULL);
+        for (int i = positions.size() - 1; i >= 0; i--)
+        {
+            bool found = false;
+            SearchListeners listeners;
+            listeners.info = [&](int index, const Search::MultiPVData& data, uint64_t nodes, double elapsed, int hashfull)
+            {
+                // Prefer the last exact score to a bound of an interrupted iteration
+                if (index == 0 && (!found || data.type == Search::BoundType::EXACT))
+                {
+                    scores[i] = data.score;
+                    found = true;
+                }
+            };
+            listeners.bestmove = [&](Move bestmove, Move ponder) { best_moves[i] = bestmove; };
+
+            pool.set_listeners(listeners);
+            pool.position() = positions[i];
+            pool.update_position_threads();
+            pool.search(Search::Timer(), limits, true);
+            report.nodes += pool.nodes_searched();
+
+            // Finished games are not searched
+            if (!found)
+                scores[i] = positions[i].in_check() && positions[i].generate_moves(MoveGenType::LEGAL).length() == 0
+                          ? -SCORE_MATE : SCORE_DRAW;
+        }
+        pool.set_listeners(SearchListeners());
+
+        for (std::size_t i = 0; i < game.moves.size(); i++)
+        {
+            MoveReport move;
+            move.played = game.moves[i];
+            move.best = best_moves[i];
+            move.best_score = scores[i];
+            move.played_score = move.played == move.best ? scores[i] : -scores[i + 1];
+            move.loss = std::max(0, capped(move.best_score) - capped(move.played_score));
+            report.moves.push_back(move);
+        }
+
+        report.elapsed = timer.elapsed();
+        return report;
+    }
+
+
+
+    std::string format(const Game& game, const GameReport& report)
+    {
+        std::ostringstream out;
+        out << game.name << ": " << report.moves.size() << " plies, " << report.nodes << " nodes, "
+            << static_cast<int>(report.elapsed * 1000) << " ms" << std::endl;
+        out << "   ply  move      eval  best   best eval  loss" << std::endl;
+
+        // Evaluations are shown from white's point of view, losses from the mover's
+        Turn turn = game.start.get_turn();
+        int total_loss[NUM_COLORS] = { 0, 0 };
+        int n_moves[NUM_COLORS] = { 0, 0 };
+        for (std::size_t i = 0; i < report.moves.size(); i++)
+        {
+            const MoveReport& move = report.moves[i];
+            int color = turn_to_color(turn);
+            out << std::setw(6) << i + 1 << "  "
+                << std::setw(6) << std::left << move.played.to_uci() << std::right
+                << std::setw(6) << score_string(color * move.played_score) << "  "
+                << std::setw(6) << std::left << (move.best == MOVE_NULL ? "-" : move.best.to_uci()) << std::right
+                << std::setw(10) << score_string(color * move.best_score)
+                << std::setw(6) << move.loss << std::endl;
+
+            total_loss[turn] += move.loss;
+            n_moves[turn]++;
+            turn = ~turn;
+        }
+
+        out << "  average loss: white " << total_loss[WHITE] / std::max(1, n_moves[WHITE])
+            << " black " << total_loss[BLACK] / std::max(1, n_moves[BLACK]) << std::endl;
+        return out.str();
+    }
+
+
+
+    void analyze_games(const std::vector<Game>& games, const Search::Limits& limits, int jobs)
+    {
+        Search::Timer timer;
+        uint64_t nodes = 0;
+        jobs = std::clamp(jobs, 1, static_cast<int>(games.size()));
+
+        if (jobs == 1)
+        {
+            // A single job runs on the engine pool, keeping its TT for later searches
+            Position position = pool->position();
+            for (auto& game : games)
+            {
+                GameReport report = analyze(*pool, game, limits);
+                nodes += report.nodes;
+                std::cout << format(game, report) << std::endl;
+            }
+            pool->position() = position;
+            pool->update_position_threads();
+        }
+        else
+        {
+            // Games are analysed in parallel, each job with its own pool and share of the threads and hash.
+            // Pools are shrunk one by one to keep the peak allocation close to a single table.
+            std::vector<std::unique_ptr<ThreadPool>> pools;
+            for (int i = 0; i < jobs; i++)
+            {
+                pools.push_back(std::make_unique<ThreadPool>());
+                pools.back()->resize(std::max(1, pool->size() / jobs));
+                pools.back()->set_memory(std::max<std::size_t>(1, pool->tt().size_mb() / jobs), pool->qtable_mb(),
+                                         std::max<std::size_t>(1, pool->tree_mb() / jobs));
+            }
+
+            std::atomic_int next(0);
+            std::mutex output_mutex;
+            std::vector<std::thread> workers;
+            for (int i = 0; i < jobs; i++)
+                workers.emplace_back([&, i]()
+                {
+                    for (int index = next++; index < static_cast<int>(games.size()); index = next++)
+                    {
+                        GameReport report = analyze(*pools[i], games[index], limits);
+                        std::lock_guard<std::mutex> lock(output_mutex);
+                        nodes += report.nodes;
+                        std::cout << format(games[index], report) << std::endl;
+                    }
+                });
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        double elapsed = timer.elapsed();
+        std::cout << "Analysis summary" << std::endl;
+        std::cout << "  Games:     " << games.size() << std::endl;
+        std::cout << "  Jobs:      " << jobs << std::endl;
+        std::cout << "  Nodes:     " << nodes << std::endl;
+        std::cout << "  Time (ms): " << static_cast<int>(elapsed * 1000) << std::endl;
+        std::cout << "  NPS:       " << static_cast<uint64_t>(nodes / std::max(elapsed, 1e-3)) << std::endl;
+    }
+}
@@ -1,4 +1,5 @@
 #include "../include/bitboard.hpp"
+#include "../include/cpu.hpp"
 #include "../include/types.hpp"
 #include <algorithm>
 
@@ -229,13 +230,23 @@ namespace Bitboards
 
 
     MagicBitboard::MagicBitboard(uint64_t magic, Bitboard blockmask, const std::vector<Bitboard>& blockboards, const std::vector<Bitboard>& moveboards)
-        : m_bits(blockmask.count()), m_magic(magic), m_blockmask(blockmask), m_moveboards(moveboards.size())
+        : m_bits(blockmask.count()), m_magic(magic), m_pext(CPU::features().fast_pext),
+          m_blockmask(blockmask), m_moveboards(moveboards.size())
     {
         for (unsigned int i = 0; i < moveboards.size(); i++)
             m_moveboards[get_index(blockboards[i])] = moveboards[i];
     }
     int MagicBitboard::get_index(Bitboard blockboard) const
     {
+#if defined(__GNUC__) && defined(__x86_64__)
+        // PEXT is emitted directly so that the same binary runs (with magics) on CPUs without BMI2
+        if (m_pext)
+        {
+            uint64_t index;
+            asm("pextq %2, %1, %0" : "=r"(index) : "r"(blockboard.to_uint64()), "r"(m_blockmask.to_uint64()));
+            return index;
+        }
+#endif
         return (blockboard.to_uint64() * m_magic) >> (64 - m_bits);
     }
     Bitboard MagicBitboard::get_moveboard(Bitboard occupancy) const
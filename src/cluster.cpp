@@ -0,0 +1,600 @@
+#include "../include/cluster.hpp"
+#include "../include/thread.hpp"
+#include "../include/uci.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+namespace Cluster
+{
+    std::atomic_bool sharing(false);
+
+
+#if defined(__linux__)
+    enum MessageType : uint32_t
+    {
+        SEARCH,     // Coordinator to worker: search id, position and go commands
+        STOP,       // Coordinator to worker: search id
+        ENTRIES,    // Both ways: array of entries
+        NODES,      // Worker to coordinator: nodes searched so far
+        RESULT      // Worker to coordinator: ResultMessage
+    };
+
+
+    struct Header
+    {
+        uint32_t type;
+        uint32_t size;
+    };
+
+
+    struct ResultMessage
+    {
+        uint64_t nodes;
+        uint32_t id;
+        uint16_t bestmove;
+        uint16_t ponder;
+        Score score;
+        Depth depth;
+    };
+
+
+    struct Peer
+    {
+        int socket;
+        std::thread reader;
+        std::mutex write_mutex;
+        std::atomic_bool alive;
+        std::atomic_uint64_t nodes;
+        uint32_t search;
+        bool has_result;
+        Result result;
+
+        Peer(int s)
+            : socket(s), alive(true), nodes(0), search(0), has_result(false)
+        {}
+    };
+
+
+    // Entries are flushed at this interval, and at most this many wait in the queue
+    constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(10);
+    constexpr std::size_t MAX_QUEUED = 1 << 16;
+
+    // Largest accepted message: a full batch of entries, or the commands of a search
+    constexpr std::size_t MAX_COMMANDS = 1 << 16;
+    constexpr std::size_t MAX_MESSAGE = std::max(MAX_QUEUED * sizeof(Entry), sizeof(uint32_t) + MAX_COMMANDS);
+
+    // Time given to the workers to send their result once stopped
+    constexpr auto RESULT_TIMEOUT = std::chrono::milliseconds(500);
+
+    // Protects the peers, their results and the outgoing entries
+    std::mutex mutex;
+    std::condition_variable cvar;
+    std::vector<std::unique_ptr<Peer>> peers;
+    std::vector<Entry> outgoing;
+    std::atomic_bool running(false);
+    std::atomic_uint64_t entries_sent(0);
+    std::atomic_uint64_t entries_received(0);
+    int listen_socket = -1;
+    uint32_t search_id = 0;
+    bool searching = false;
+    std::thread acceptor;
+    std::thread flusher;
+
+
+
+    bool send_all(int socket, const void* data, std::size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            ssize_t sent = ::send(socket, bytes, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+
+    bool recv_all(int socket, void* data, std::size_t size)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            ssize_t received = ::recv(socket, bytes, size, 0);
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= received;
+        }
+        return true;
+    }
+
+
+    bool send_message(int socket, std::mutex& write_mutex, MessageType type, const void* data, std::size_t size)
+    {
+        Header header{ type, static_cast<uint32_t>(size) };
+        std::lock_guard<std::mutex> lock(write_mutex);
+        return send_all(socket, &header, sizeof(header)) && send_all(socket, data, size);
+    }
+
+
+    bool receive_message(int socket, Header& header, std::vector<char>& payload)
+    {
+        if (!recv_all(socket, &header, sizeof(header)) || header.size > MAX_MESSAGE)
+            return false;
+        payload.resize(header.size);
+        return recv_all(socket, payload.data(), header.size);
+    }
+
+
+    void store_entries(const std::vector<char>& payload)
+    {
+        HashTable<TranspositionEntry>& ttable = pool->tt();
+        entries_received += payload.size() / sizeof(Entry);
+        for (std::size_t offset = 0; offset + sizeof(Entry) <= payload.size(); offset += sizeof(Entry))
+        {
+            Entry entry;
+            std::memcpy(&entry, payload.data() + offset, sizeof(Entry));
+            ttable.store(entry.hash, entry.depth, entry.score, Move::from_int(entry.move),
+                         static_cast<EntryType>(entry.type), entry.static_eval);
+        }
+    }
+
+
+    // Peers still connected, other than the given one. Peers are only destroyed once the cluster threads
+    // have been joined, so the threads can use them after releasing the lock.
+    std::vector<Peer*> alive_peers(const Peer* except = nullptr)
+    {
+        std::vector<Peer*> result;
+        for (auto& peer : peers)
+            if (peer.get() != except && peer->alive)
+                result.push_back(peer.get());
+        return result;
+    }
+
+
+    // Sends the queued entries every FLUSH_INTERVAL. Workers also report their node count. The sends
+    // happen outside the lock, so that a slow peer does not hold up the search threads queueing entries.
+    void flush_loop(bool worker)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running)
+        {
+            cvar.wait_for(lock, FLUSH_INTERVAL);
+            if (!sharing || peers.empty())
+                continue;
+
+            std::vector<Entry> entries;
+            entries.swap(outgoing);
+            std::vector<Peer*> targets = alive_peers();
+            lock.unlock();
+            for (Peer* peer : targets)
+            {
+                if (!entries.empty() &&
+                    send_message(peer->socket, peer->write_mutex, ENTRIES,
+                                 entries.data(), entries.size() * sizeof(Entry)))
+                    entries_sent += entries.size();
+                if (worker)
+                {
+                    uint64_t nodes = pool->nodes_searched();
+                    send_message(peer->socket, peer->write_mutex, NODES, &nodes, sizeof(nodes));
+                }
+            }
+            lock.lock();
+        }
+    }
+
+
+    // Coordinator: handles the messages of a worker, relaying its entries to the other workers
+    void read_loop(Peer* peer)
+    {
+        Header header;
+        std::vector<char> payload;
+        while (receive_message(peer->socket, header, payload))
+        {
+            if (header.type == ENTRIES)
+            {
+                store_entries(payload);
+                std::vector<Peer*> others;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    others = alive_peers(peer);
+                }
+                for (Peer* other : others)
+                    send_message(other->socket, other->write_mutex, ENTRIES, payload.data(), payload.size());
+            }
+            else if (header.type == NODES && payload.size() == sizeof(uint64_t))
+            {
+                uint64_t nodes;
+                std::memcpy(&nodes, payload.data(), sizeof(nodes));
+                peer->nodes = nodes;
+            }
+            else if (header.type == RESULT && payload.size() == sizeof(ResultMessage))
+            {
+                ResultMessage message;
+                std::memcpy(&message, payload.data(), sizeof(message));
+                std::lock_guard<std::mutex> lock(mutex);
+                if (message.id == search_id)
+                {
+                    peer->nodes = message.nodes;
+                    peer->result = Result{ Move::from_int(message.bestmove), Move::from_int(message.ponder),
+                                           message.score, message.depth };
+                    peer->has_result = true;
+                    cvar.notify_all();
+                }
+            }
+        }
+
+        // Disconnected, or dropped after an invalid message
+        peer->alive = false;
+        ::shutdown(peer->socket, SHUT_RDWR);
+        std::lock_guard<std::mutex> lock(mutex);
+        cvar.notify_all();
+    }
+
+
+    void accept_loop()
+    {
+        while (running)
+        {
+            int socket = ::accept(listen_socket, nullptr, nullptr);
+            if (socket < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                break;
+            }
+
+            int flag = 1;
+            ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+            std::lock_guard<std::mutex> lock(mutex);
+            peers.push_back(std::make_unique<Peer>(socket));
+            Peer* peer = peers.back().get();
+            peer->reader = std::thread(read_loop, peer);
+            std::cout << "info string cluster worker " << peers.size() - 1 << " connected" << std::endl;
+        }
+    }
+
+
+
+    void queue(const Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (outgoing.size() < MAX_QUEUED)
+            outgoing.push_back(entry);
+    }
+
+
+    bool listen(int port)
+    {
+        if (running)
+            return false;
+
+        int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (socket < 0)
+            return false;
+
+        int flag = 1;
+        ::setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (::bind(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            ::listen(socket, 16) < 0)
+        {
+            ::close(socket);
+            return false;
+        }
+
+        listen_socket = socket;
+        running = true;
+        acceptor = std::thread(accept_loop);
+        flusher = std::thread(flush_loop, false);
+        return true;
+    }
+
+
+    bool join(const std::string& host, int port)
+    {
+        if (running)
+            return false;
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            return false;
+
+        int socket = -1;
+        for (addrinfo* address = addresses; address && socket < 0; address = address->ai_next)
+        {
+            socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socket >= 0 && ::connect(socket, address->ai_addr, address->ai_addrlen) < 0)
+            {
+                ::close(socket);
+                socket = -1;
+            }
+        }
+        ::freeaddrinfo(addresses);
+        if (socket < 0)
+            return false;
+
+        int flag = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+        // The coordinator is the only peer of a worker
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            peers.push_back(std::make_unique<Peer>(socket));
+        }
+        Peer& coordinator = *peers.front();
+        running = true;
+        flusher = std::thread(flush_loop, true);
+        std::cout << "info string cluster joined " << host << ":" << port << std::endl;
+
+        // Results are captured instead of written to stdout
+        uint32_t current_id = 0;
+        Search::MultiPVData last_pv;
+        SearchListeners listeners;
+        listeners.info = [&](int index, const Search::MultiPVData& pv, uint64_t nodes, double elapsed, int hashfull)
+        {
+            if (index == 0)
+                last_pv = pv;
+        };
+        listeners.bestmove = [&](Move bestmove, Move ponder)
+        {
+            sharing = false;
+            ResultMessage message{ static_cast<uint64_t>(pool->nodes_searched()), current_id,
+                                   static_cast<uint16_t>(bestmove.to_int()), static_cast<uint16_t>(ponder.to_int()),
+                                   last_pv.score, last_pv.depth };
+            send_message(coordinator.socket, coordinator.write_mutex, RESULT, &message, sizeof(message));
+        };
+        pool->set_listeners(listeners);
+
+        Header header;
+        std::vector<char> payload;
+        while (receive_message(socket, header, payload))
+        {
+            if (header.type == SEARCH && payload.size() >= sizeof(uint32_t))
+            {
+                // Stop any previous search before replacing the root
+                UCI::Stream none;
+                UCI::stop(none);
+                pool->wait();
+
+                std::memcpy(&current_id, payload.data(), sizeof(current_id));
+                std::istringstream commands(std::string(payload.begin() + sizeof(uint32_t), payload.end()));
+                std::string line, token;
+                last_pv = Search::MultiPVData();
+                sharing = true;
+                while (std::getline(commands, line))
+                {
+                    UCI::Stream stream(line);
+                    stream >> token;
+                    if (token == "position")
+                        UCI::position(stream);
+                    else if (token == "go")
+                        UCI::go(stream);
+                }
+            }
+            else if (header.type == STOP && payload.size() == sizeof(uint32_t))
+            {
+                uint32_t id;
+                std::memcpy(&id, payload.data(), sizeof(id));
+                if (id == current_id)
+                {
+                    UCI::Stream none;
+                    UCI::stop(none);
+                }
+            }
+            else if (header.type == ENTRIES)
+                store_entries(payload);
+        }
+
+        // Coordinator gone: stop searching and return to the UCI loop
+        UCI::Stream none;
+        UCI::stop(none);
+        pool->wait();
+        pool->set_listeners(SearchListeners());
+        std::cout << "info string cluster coordinator disconnected" << std::endl;
+        shutdown();
+        return true;
+    }
+
+
+    bool active()
+    {
+        if (!running)
+            return false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return listen_socket >= 0 &&
+               std::any_of(peers.begin(), peers.end(), [](const auto& peer) { return peer->alive.load(); });
+    }
+
+
+    void start_search(const std::string& position, const std::vector<Move>& searchmoves)
+    {
+        // Workers search without limits until stopped by the coordinator
+        std::ostringstream commands;
+        commands << position << "\ngo infinite";
+        if (!searchmoves.empty())
+        {
+            commands << " searchmoves";
+            for (Move move : searchmoves)
+                commands << " " << move;
+        }
+        commands << "\n";
+
+        // Longer commands would be rejected by the workers: the search stays local
+        std::string text = commands.str();
+        if (text.size() > MAX_COMMANDS)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        search_id++;
+        std::vector<char> payload(sizeof(uint32_t) + text.size());
+        std::memcpy(payload.data(), &search_id, sizeof(uint32_t));
+        std::memcpy(payload.data() + sizeof(uint32_t), text.data(), text.size());
+
+        outgoing.clear();
+        for (auto& peer : peers)
+        {
+            peer->nodes = 0;
+            peer->has_result = false;
+            if (peer->alive && send_message(peer->socket, peer->write_mutex, SEARCH, payload.data(), payload.size()))
+                peer->search = search_id;
+        }
+        searching = true;
+        sharing = true;
+    }
+
+
+    int finish_search(const Position& position, Result& best)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!searching)
+            return -1;
+
+        searching = false;
+        sharing = false;
+        for (auto& peer : peers)
+            if (peer->alive && peer->search == search_id)
+                send_message(peer->socket, peer->write_mutex, STOP, &search_id, sizeof(search_id));
+
+        // Wait for the results of the workers still connected
+        auto all_results = [&]()
+        {
+            return std::all_of(peers.begin(), peers.end(),
+                               [](const auto& peer)
+                               {
+                                   return peer->has_result || !peer->alive || peer->search != search_id;
+                               });
+        };
+        cvar.wait_for(lock, RESULT_TIMEOUT, all_results);
+
+        // The deepest result wins, then the highest score
+        int chosen = -1;
+        for (std::size_t i = 0; i < peers.size(); i++)
+        {
+            const Result& result = peers[i]->result;
+            if (!peers[i]->has_result || !position.board().legal(result.bestmove))
+                continue;
+            if (result.depth > best.depth || (result.depth == best.depth && result.score > best.score))
+            {
+                best = result;
+                chosen = i;
+            }
+        }
+
+        // Drop a ponder move that does not follow the chosen bestmove
+        if (chosen >= 0 && best.ponder != MOVE_NULL && !position.board().make_move(best.bestmove).legal(best.ponder))
+            best.ponder = MOVE_NULL;
+        return chosen;
+    }
+
+
+    uint64_t remote_nodes()
+    {
+        if (!running)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t nodes = 0;
+        for (auto& peer : peers)
+            nodes += peer->nodes;
+        return nodes;
+    }
+
+
+    void status(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+        {
+            out << "info string cluster inactive" << std::endl;
+            return;
+        }
+
+        int alive = std::count_if(peers.begin(), peers.end(), [](const auto& peer) { return peer->alive.load(); });
+        if (listen_socket >= 0)
+            out << "info string cluster coordinator with " << alive << " workers connected";
+        else
+            out << "info string cluster worker";
+        out << ", " << entries_sent << " entries sent, " << entries_received << " received" << std::endl;
+    }
+
+
+    void shutdown()
+    {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running)
+                return;
+
+            running = false;
+            sharing = false;
+            if (listen_socket >= 0)
+                ::shutdown(listen_socket, SHUT_RDWR);
+            for (auto& peer : peers)
+                ::shutdown(peer->socket, SHUT_RDWR);
+
+            threads.push_back(std::move(acceptor));
+            threads.push_back(std::move(flusher));
+            for (auto& peer : peers)
+                threads.push_back(std::move(peer->reader));
+            cvar.notify_all();
+        }
+
+        // Joined outside the lock, which the threads take while finishing
+        for (auto& thread : threads)
+            if (thread.joinable())
+                thread.join();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& peer : peers)
+            ::close(peer->socket);
+        peers.clear();
+        outgoing.clear();
+        if (listen_socket >= 0)
+            ::close(listen_socket);
+        listen_socket = -1;
+    }
+#else
+    void queue(const Entry& entry) {}
+    bool listen(int port) { return false; }
+    bool join(const std::string& host, int port) { return false; }
+    bool active() { return false; }
+    void start_search(const std::string& position, const std::vector<Move>& searchmoves) {}
+    int finish_search(const Position& position, Result& best) { return -1; }
+    uint64_t remote_nodes() { return 0; }
+    void status(std::ostream& out) { out << "info string cluster not supported on this platform" << std::endl; }
+    void shutdown() {}
+#endif
+}
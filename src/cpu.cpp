@@ -0,0 +1,270 @@
+#include "../include/cpu.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+
+namespace CPU
+{
+    Features cpu_features = { false, false, false, false };
+
+
+    void init()
+    {
+#if defined(__GNUC__) && defined(__x86_64__)
+        __builtin_cpu_init();
+        cpu_features.popcnt = __builtin_cpu_supports("popcnt");
+        cpu_features.bmi2 = __builtin_cpu_supports("bmi2");
+        cpu_features.avx2 = __builtin_cpu_supports("avx2");
+
+        // PEXT is microcoded (and slower than magics) on AMD processors before Zen 3
+        cpu_features.fast_pext = cpu_features.bmi2 &&
+                                 !__builtin_cpu_is("znver1") &&
+                                 !__builtin_cpu_is("znver2");
+#endif
+    }
+
+
+    const Features& features()
+    {
+        return cpu_features;
+    }
+
+
+    std::string kernel_target()
+    {
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_MULTIVERSION)
+        // Same priority order as the resolver of TARGET_CLONES
+        if (__builtin_cpu_supports("x86-64-v3"))
+            return "x86-64-v3";
+        if (cpu_features.popcnt)
+            return "popcnt";
+        return "default";
+#else
+        return "compile-time";
+#endif
+    }
+
+
+    std::string description()
+    {
+        return "kernels " + kernel_target()
+             + " sliders " + (cpu_features.fast_pext ? "pext" : "magics");
+    }
+
+
+
+#if defined(__linux__)
+    std::string read_line(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+
+    // CPU ids of a list such as "0-3,8,10-11"
+    std::set<int> parse_cpu_list(const std::string& list)
+    {
+        std::set<int> cpus;
+        std::istringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            int first, last;
+            char dash;
+            std::istringstream range_stream(range);
+            if (!(range_stream >> first))
+                continue;
+            if (!(range_stream >> dash >> last))
+                last = first;
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.insert(cpu);
+        }
+        return cpus;
+    }
+
+
+    // Directories of the cgroups of the process, from the innermost to the hierarchy roots (limits of
+    // the parents apply too). Inside containers the paths may refer to the host hierarchy, in which case
+    // only the mount points are readable.
+    std::vector<std::string> cgroup_dirs()
+    {
+        std::vector<std::string> dirs;
+        std::ifstream file("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(file, line))
+        {
+            // Lines are id:controllers:path, with an empty controller list for cgroup v2
+            std::size_t first = line.find(':');
+            std::size_t second = line.find(':', first + 1);
+            if (first == std::string::npos || second == std::string::npos)
+                continue;
+
+            std::string controllers = line.substr(first + 1, second - first - 1);
+            std::string path = line.substr(second + 1);
+            std::string mount = "/sys/fs/cgroup" + (controllers.empty() ? "" : "/" + controllers);
+            while (true)
+            {
+                dirs.push_back(mount + path);
+                if (path.empty() || path == "/")
+                    break;
+                path.erase(path.rfind('/'));
+            }
+        }
+        return dirs;
+    }
+
+
+    double cgroup_quota(const std::vector<std::string>& dirs)
+    {
+        double quota = 0;
+        for (const auto& dir : dirs)
+        {
+            // cgroup v2: "max 100000" or "<quota> <period>"; cgroup v1: separate files, -1 if unlimited
+            double limit = 0, period = 0;
+            std::istringstream v2(read_line(dir + "/cpu.max"));
+            std::string max;
+            if (v2 >> max >> period && max != "max")
+                limit = std::stod(max);
+            else
+            {
+                std::istringstream v1_quota(read_line(dir + "/cpu.cfs_quota_us"));
+                std::istringstream v1_period(read_line(dir + "/cpu.cfs_period_us"));
+                if (!(v1_quota >> limit && v1_period >> period))
+                    limit = 0;
+            }
+
+            if (limit > 0 && period > 0)
+                quota = (quota == 0) ? limit / period : std::min(quota, limit / period);
+        }
+        return quota;
+    }
+
+
+    std::size_t cgroup_memory(const std::vector<std::string>& dirs)
+    {
+        std::size_t memory = 0;
+        for (const auto& dir : dirs)
+            for (const char* name : { "/memory.max", "/memory.limit_in_bytes" })
+            {
+                // Unlimited groups report "max" (v2) or a huge page-aligned value (v1)
+                std::istringstream stream(read_line(dir + name));
+                std::size_t limit;
+                if (stream >> limit && limit > 0)
+                    memory = (memory == 0) ? limit : std::min(memory, limit);
+            }
+        return memory;
+    }
+#endif
+
+
+    Resources resources()
+    {
+        Resources res = { static_cast<int>(std::max(1u, std::thread::hardware_concurrency())), 0, 0, 0, 0 };
+
+#if defined(__linux__)
+        // CPUs we may run on: the affinity mask, restricted to the effective cpusets of our cgroups
+        std::set<int> cpus;
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &mask))
+                    cpus.insert(cpu);
+
+        std::vector<std::string> dirs = cgroup_dirs();
+        for (const auto& dir : dirs)
+            for (const char* name : { "/cpuset.cpus.effective", "/cpuset.effective_cpus" })
+            {
+                std::set<int> cpuset = parse_cpu_list(read_line(dir + name));
+                if (cpuset.empty())
+                    continue;
+
+                std::set<int> allowed;
+                std::set_intersection(cpus.begin(), cpus.end(), cpuset.begin(), cpuset.end(),
+                                      std::inserter(allowed, allowed.begin()));
+                if (!allowed.empty())
+                    cpus = allowed;
+            }
+
+        // Physical cores: SMT siblings share the same sibling list
+        std::set<std::string> cores;
+        for (int cpu : cpus)
+        {
+            std::string siblings = read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+            cores.insert(siblings.empty() ? std::to_string(cpu) : siblings);
+        }
+
+        if (!cpus.empty())
+            res.logical = cpus.size();
+        res.cores = cores.size();
+        res.quota = cgroup_quota(dirs);
+        res.memory_limit = cgroup_memory(dirs);
+
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long page_size = sysconf(_SC_PAGE_SIZE);
+        if (pages > 0 && page_size > 0)
+            res.physical_memory = static_cast<std::size_t>(pages) * page_size;
+#endif
+
+        if (res.cores == 0)
+            res.cores = res.logical;
+        if (res.memory_limit >= res.physical_memory)
+            res.memory_limit = 0;
+        return res;
+    }
+
+
+    std::string describe(const Resources& res)
+    {
+        constexpr std::size_t MB = 1024 * 1024;
+        std::ostringstream out;
+        out << "cpus " << res.logical << " cores " << res.cores << " quota ";
+        if (res.quota > 0)
+            out << std::fixed << std::setprecision(2) << res.quota;
+        else
+            out << "none";
+        out << " memory " << res.physical_memory / MB << " MB limit ";
+        if (res.memory_limit > 0)
+            out << res.memory_limit / MB << " MB";
+        else
+            out << "none";
+        return out.str();
+    }
+
+
+    int auto_threads(const Resources& res)
+    {
+        // One thread per physical core: Lazy SMP gains little from SMT siblings. A CPU quota caps the
+        // count (rounded down, so that we never get throttled) but may also use the SMT siblings.
+        if (res.quota > 0)
+            return std::clamp(static_cast<int>(res.quota), 1, res.logical);
+        return std::max(1, res.cores);
+    }
+
+
+    int auto_hash(const Resources& res, int max_hash)
+    {
+        // Half of the cgroup memory limit, or an eighth of the physical memory without one, rounded down
+        // to a power of two
+        constexpr std::size_t MB = 1024 * 1024;
+        std::size_t budget = (res.memory_limit > 0) ? res.memory_limit / 2 : res.physical_memory / 8;
+        std::size_t hash = 1;
+        while (hash * 2 <= budget / MB && hash * 2 <= static_cast<std::size_t>(max_hash))
+            hash *= 2;
+        return hash;
+    }
+}
@@ -1,5 +1,6 @@
 #include "../include/types.hpp"
 #include "../include/bitboard.hpp"
+#include "../include/cpu.hpp"
 #include "../include/position.hpp"
 #include "../include/evaluation.hpp"
 #include "../include/piece_square_tables.hpp"
@@ -280,9 +281,9 @@ MixedScore king_safety(const Board& board, EvalData& data)
     while (slider_attackers)
         score += SliderAttackers[Bitboards::between(king_sq, slider_attackers.bitscan_forward_reset()).count()];
 
-    // Attackers to the squares near the king
+    // Attackers to the squares near the king (only squares in the attack map can have any)
     int attacked_squares = 0;
-    Bitboard b = mask;
+    Bitboard b = mask & board.threats<~TURN>();
     while(b)
         attacked_squares += board.attackers_battery<~TURN>(b.bitscan_forward_reset(), occupancy).count();
     score += SquaresAttacked[std::min(9, attacked_squares)];
@@ -320,6 +321,7 @@ MixedScore space(const Board& board, EvalData& data)
 }
 
 
+TARGET_CLONES
 Score evaluation(const Board& board, EvalData& data)
 {
     MixedScore mixed_result(0, 0);
@@ -1,4 +1,3 @@
 #include "../include/hash.hpp"
 
-HashTable<TranspositionEntry> ttable;
 HashTable<PerftEntry> perft_table;
@@ -1,4 +1,5 @@
 #include "../include/types.hpp"
+#include "../include/cpu.hpp"
 #include "../include/position.hpp"
 #include "../include/tests.hpp"
 #include "../include/zobrist.hpp"
@@ -9,10 +10,10 @@
 
 int main()
 {
+    CPU::init();
     Bitboards::init_bitboards();
     Zobrist::build_rnd_hashes();
     UCI::init_options();
-    ttable = HashTable<TranspositionEntry>(16);
     pool = new ThreadPool();
 
     UCI::main_loop();
@@ -0,0 +1,311 @@
+#include "../include/hive.h"
+#include "../include/types.hpp"
+#include "../include/cpu.hpp"
+#include "../include/position.hpp"
+#include "../include/evaluation.hpp"
+#include "../include/zobrist.hpp"
+#include "../include/search.hpp"
+#include "../include/uci.hpp"
+#include "../include/thread.hpp"
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+
+struct hive_engine
+{
+    ThreadPool pool;
+    std::mutex mutex;
+    std::atomic_bool stop;
+};
+
+
+namespace
+{
+    void init_once()
+    {
+        static std::once_flag flag;
+        std::call_once(flag, []()
+        {
+            CPU::init();
+            Bitboards::init_bitboards();
+            Zobrist::build_rnd_hashes();
+            UCI::init_options();
+        });
+    }
+
+
+    // Rejects FENs the board parser would silently misread
+    bool valid_fen(const std::string& fen)
+    {
+        std::istringstream stream(fen);
+        std::string board, turn;
+        if (!(stream >> board >> turn) || (turn != "w" && turn != "b"))
+            return false;
+
+        int rank_squares = 0, ranks = 1;
+        int kings[NUM_COLORS] = { 0, 0 };
+        for (char c : board)
+            if (c == '/')
+            {
+                if (rank_squares != 8)
+                    return false;
+                rank_squares = 0;
+                ranks++;
+            }
+            else if (c >= '1' && c <= '8')
+                rank_squares += c - '0';
+            else if (c != '\0' && std::strchr("pnbrqkPNBRQK", c))
+            {
+                rank_squares++;
+                if (tolower(c) == 'k')
+                    kings[isupper(c) ? WHITE : BLACK]++;
+            }
+            else
+                return false;
+
+        return ranks == 8 && rank_squares == 8 && kings[WHITE] == 1 && kings[BLACK] == 1;
+    }
+
+
+    std::string packed_to_fen(const uint8_t* packed)
+    {
+        const char pieces[] = " PNBRQK  pnbrqk ";
+        std::string fen;
+        for (int rank = 7; rank >= 0; rank--)
+        {
+            int empty = 0;
+            for (int file = 0; file < 8; file++)
+            {
+                int square = rank * 8 + file;
+                int nibble = (packed[square / 2] >> (4 * (square % 2))) & 0xF;
+                if (pieces[nibble] == ' ')
+                {
+                    if (nibble != 0)
+                        return "";
+                    empty++;
+                    continue;
+                }
+
+                if (empty)
+                    fen += std::to_string(empty);
+                fen += pieces[nibble];
+                empty = 0;
+            }
+            if (empty)
+                fen += std::to_string(empty);
+            if (rank > 0)
+                fen += '/';
+        }
+
+        uint8_t flags = packed[32];
+        fen += (flags & 1) ? " b " : " w ";
+        std::string castling;
+        const char rights[] = "KQkq";
+        for (int i = 0; i < 4; i++)
+            if (flags & (2 << i))
+                castling += rights[i];
+        fen += castling.empty() ? "-" : castling;
+
+        uint8_t ep = packed[33];
+        if (ep < 64)
+            fen += std::string(" ") + char('a' + ep % 8) + char('1' + ep / 8);
+        else if (ep == 255)
+            fen += " -";
+        else
+            return "";
+
+        fen += " " + std::to_string(packed[34]);
+        fen += " " + std::to_string(packed[35] | (packed[36] << 8));
+        return fen;
+    }
+
+
+    void copy_move(char* dst, Move move)
+    {
+        std::string str = move == MOVE_NULL ? "" : move.to_uci();
+        std::strncpy(dst, str.c_str(), 5);
+        dst[5] = '\0';
+    }
+}
+
+
+extern "C"
+{
+    hive_engine* hive_create(int threads, int hash_mb)
+    {
+        if (threads < 1 || hash_mb < 1 || hash_mb > HashTable<TranspositionEntry>::max_size())
+            return nullptr;
+
+        init_once();
+        hive_engine* engine = new hive_engine();
+        engine->stop = false;
+        engine->pool.resize(threads);
+        engine->pool.set_memory(hash_mb, 1, hash_mb);
+        return engine;
+    }
+
+
+    void hive_destroy(hive_engine* engine)
+    {
+        delete engine;
+    }
+
+
+    int hive_set_fen(hive_engine* engine, const char* fen)
+    {
+        if (!engine || !fen || !valid_fen(fen))
+            return -1;
+
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        engine->pool.position() = Position(fen);
+        engine->pool.update_position_threads();
+        return 0;
+    }
+
+
+    int hive_set_packed(hive_engine* engine, const uint8_t* packed, size_t size)
+    {
+        if (!packed || size < HIVE_PACKED_SIZE)
+            return -1;
+
+        std::string fen = packed_to_fen(packed);
+        return fen.empty() ? -1 : hive_set_fen(engine, fen.c_str());
+    }
+
+
+    int hive_play(hive_engine* engine, const char* uci_move)
+    {
+        if (!engine || !uci_move)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        Position& position = engine->pool.position();
+        Move move = UCI::move_from_uci(position, uci_move);
+        if (move == MOVE_NULL)
+            return -1;
+
+        position.make_move(move);
+        position.set_init_ply();
+        engine->pool.update_position_threads();
+        return 0;
+    }
+
+
+    int hive_eval(hive_engine* engine)
+    {
+        if (!engine)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        const Position& position = engine->pool.position();
+        return turn_to_color(position.get_turn()) * evaluate<false>(position);
+    }
+
+
+    int hive_search(hive_engine* engine, const hive_limits* limits,
+                    hive_info_callback callback, void* user, hive_result* result)
+    {
+        if (!engine || !limits || !result ||
+            (limits->depth <= 0 && limits->nodes == 0 && limits->movetime_ms <= 0))
+            return -1;
+
+        // Only the stop requests made from now on apply to this search
+        engine->stop = false;
+
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        std::memset(result, 0, sizeof(hive_result));
+
+        Search::Timer timer;
+        Search::Limits search_limits;
+        if (limits->depth > 0)
+            search_limits.depth = std::min(limits->depth, NUM_MAX_DEPTH - 1);
+        if (limits->nodes > 0)
+            search_limits.nodes = limits->nodes;
+        if (limits->movetime_ms > 0)
+            search_limits.movetime = limits->movetime_ms;
+
+        SearchListeners listeners;
+        listeners.info = [&](int index, const Search::MultiPVData& data, uint64_t nodes, double elapsed, int hashfull)
+        {
+            hive_info info;
+            info.multipv = index + 1;
+            info.depth = data.depth;
+            info.seldepth = data.seldepth;
+            info.score_cp = is_mate(data.score) ? 0 : data.score;
+            info.mate = is_mate(data.score) ? mate_in(data.score) : 0;
+            info.bound = data.type == Search::BoundType::EXACT       ? HIVE_BOUND_EXACT
+                       : data.type == Search::BoundType::LOWER_BOUND ? HIVE_BOUND_LOWER
+                       :                                               HIVE_BOUND_UPPER;
+            info.nodes = nodes;
+            info.elapsed = elapsed;
+            info.hashfull = hashfull;
+
+            std::string pv;
+            for (const Move* m = data.pv; *m != MOVE_NULL; m++)
+                pv += (pv.empty() ? "" : " ") + m->to_uci();
+            info.pv = pv.c_str();
+
+            if (index == 0)
+            {
+                result->score_cp = info.score_cp;
+                result->mate = info.mate;
+                result->depth = info.depth;
+            }
+            if (callback)
+                callback(&info, user);
+        };
+        listeners.bestmove = [&](Move bestmove, Move ponder)
+        {
+            copy_move(result->bestmove, bestmove);
+            copy_move(result->ponder, ponder);
+            if (bestmove == MOVE_NULL)
+                std::strcpy(result->bestmove, "0000");
+        };
+
+        // A stop made before the pool started searching would be lost, so the flag is checked again once
+        // the search is running
+        engine->pool.set_listeners(listeners);
+        engine->pool.search(timer, search_limits);
+        if (engine->stop)
+            engine->pool.stop();
+        engine->pool.wait();
+        engine->pool.set_listeners(SearchListeners());
+        result->nodes = engine->pool.nodes_searched();
+        return 0;
+    }
+
+
+    void hive_stop(hive_engine* engine)
+    {
+        // Not serialised with the engine mutex: this is meant to interrupt a running hive_search
+        if (engine)
+        {
+            engine->stop = true;
+            engine->pool.stop();
+        }
+    }
+
+
+    int64_t hive_perft(hive_engine* engine, int depth)
+    {
+        if (!engine || depth < 1)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        return Search::parallel_perft(engine->pool, engine->pool.position(), depth, false);
+    }
+
+
+    void hive_clear(hive_engine* engine)
+    {
+        if (!engine)
+            return;
+
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        engine->pool.clear();
+    }
+}
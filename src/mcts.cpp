@@ -0,0 +1,375 @@
+#include "../include/types.hpp"
+#include "../include/move.hpp"
+#include "../include/position.hpp"
+#include "../include/hash.hpp"
+#include "../include/move_order.hpp"
+#include "../include/search.hpp"
+#include "../include/mcts.hpp"
+#include "../include/thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace Search
+{
+    // Tree parameters
+    constexpr int BLOCK_SIZE = 65536;
+    constexpr int MAX_TREE_DEPTH = NUM_MAX_PLY / 2;
+    constexpr Depth LEAF_DEPTH = 1;
+    constexpr double CPUCT = 1.5;
+    constexpr double FPU_REDUCTION = 0.1;
+    constexpr double PRIOR_DECAY = 0.8;
+    constexpr double VALUE_SCALE = 300.0;
+    constexpr double VALUE_UNIT = 1 << 20;
+
+
+    double score_to_value(Score score)
+    {
+        if (is_mate(score))
+            return score > 0 ? 1.0 : 0.0;
+        return 1.0 / (1.0 + std::exp(-score / VALUE_SCALE));
+    }
+
+
+    Score value_to_score(double value)
+    {
+        value = std::clamp(value, 1e-6, 1.0 - 1e-6);
+        double score = VALUE_SCALE * std::log(value / (1.0 - value));
+        return static_cast<Score>(std::clamp(score, -SCORE_MATE_FOUND + 1.0, SCORE_MATE_FOUND - 1.0));
+    }
+
+
+
+    MCTSNode::MCTSNode()
+    {
+        reset(MOVE_NULL, 1.0f);
+    }
+
+    void MCTSNode::reset(Move move, float prior)
+    {
+        this->move = move;
+        this->prior = prior;
+        state.store(NodeState::UNEXPANDED, std::memory_order_relaxed);
+        n_children.store(0, std::memory_order_relaxed);
+        children.store(nullptr, std::memory_order_relaxed);
+        visits.store(0, std::memory_order_relaxed);
+        virtual_loss.store(0, std::memory_order_relaxed);
+        value.store(0, std::memory_order_relaxed);
+    }
+
+    double MCTSNode::q(double default_q) const
+    {
+        // Virtual losses count as visits without any value, steering other threads away from this node
+        int n = visits.load(std::memory_order_relaxed) + virtual_loss.load(std::memory_order_relaxed);
+        if (n == 0)
+            return default_q;
+        return value.load(std::memory_order_relaxed) / VALUE_UNIT / n;
+    }
+
+
+
+    MCTSTree::MCTSTree()
+        : m_max_nodes(0),
+          m_n_nodes(0),
+          m_iterations(0),
+          m_depth_sum(0),
+          m_max_depth(0)
+    {}
+
+
+    void MCTSTree::clear(int n_threads, std::size_t size_mb)
+    {
+        // Keep previously allocated blocks around and only rewind the arenas, unless they exceed the new size
+        m_max_nodes = size_mb * 1024 * 1024 / sizeof(MCTSNode);
+        bool release = memory() > size_mb * 1024 * 1024;
+        m_root.reset(MOVE_NULL, 1.0f);
+        m_arenas.resize(n_threads);
+        for (auto& arena : m_arenas)
+        {
+            if (release)
+                arena.blocks.clear();
+            arena.current = -1;
+            arena.used = BLOCK_SIZE;
+        }
+
+        m_n_nodes.store(0);
+        m_iterations.store(0);
+        m_depth_sum.store(0);
+        m_max_depth.store(0);
+    }
+
+
+    MCTSNode* MCTSTree::allocate(int thread_id, int n_nodes)
+    {
+        // Respect the memory budget
+        if (m_n_nodes.fetch_add(n_nodes, std::memory_order_relaxed) + n_nodes > m_max_nodes)
+        {
+            m_n_nodes.fetch_sub(n_nodes, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        // Move to the next block if the current one cannot hold all the children
+        Arena& arena = m_arenas[thread_id];
+        if (arena.used + n_nodes > BLOCK_SIZE)
+        {
+            arena.current++;
+            arena.used = 0;
+            if (arena.current >= static_cast<int>(arena.blocks.size()))
+                arena.blocks.push_back(std::make_unique<MCTSNode[]>(BLOCK_SIZE));
+        }
+
+        MCTSNode* nodes = arena.blocks[arena.current].get() + arena.used;
+        arena.used += n_nodes;
+        return nodes;
+    }
+
+
+    MCTSNode* MCTSTree::select(const MCTSNode* node) const
+    {
+        MCTSNode* children = node->children.load(std::memory_order_relaxed);
+        int n_children = node->n_children.load(std::memory_order_relaxed);
+
+        // PUCT selection, with unvisited children valued slightly below their parent
+        int parent_visits = node->visits.load(std::memory_order_relaxed) + node->virtual_loss.load(std::memory_order_relaxed);
+        double exploration = CPUCT * std::sqrt(std::max(1, parent_visits));
+        double fpu = 1.0 - node->q(0.5) - FPU_REDUCTION;
+
+        MCTSNode* best = children;
+        double best_score = -1;
+        for (int i = 0; i < n_children; i++)
+        {
+            MCTSNode* child = children + i;
+            int n = child->visits.load(std::memory_order_relaxed) + child->virtual_loss.load(std::memory_order_relaxed);
+            double score = child->q(fpu) + exploration * child->prior / (1 + n);
+            if (score > best_score)
+            {
+                best_score = score;
+                best = child;
+            }
+        }
+        return best;
+    }
+
+
+    void MCTSTree::expand(MCTSNode* node, Position& position, Thread& thread, Depth ply)
+    {
+        // Children are generated in move ordering order, which also provides their priors
+        Move move;
+        Move moves[NUM_MAX_MOVES];
+        MoveList list(moves);
+        TranspositionEntry* entry = nullptr;
+        Move tt_move = thread.pool().tt().query(position.hash(), &entry) ? entry->hash_move() : MOVE_NULL;
+        MoveOrder orderer = MoveOrder(position, ply, NUM_MAX_DEPTH, tt_move, thread.m_histories, node->move);
+        while ((move = orderer.next_move()) != MOVE_NULL)
+            if (node != &m_root || thread.is_root_move(move))
+                list.push(move);
+
+        // Checkmate or stalemate
+        if (list.length() == 0)
+        {
+            node->state.store(NodeState::TERMINAL, std::memory_order_release);
+            return;
+        }
+
+        // Out of memory: leave the node as a leaf
+        MCTSNode* children = allocate(thread.id(), list.length());
+        if (!children)
+        {
+            node->state.store(NodeState::UNEXPANDED, std::memory_order_release);
+            return;
+        }
+
+        double total = (1 - std::pow(PRIOR_DECAY, list.length())) / (1 - PRIOR_DECAY);
+        double weight = 1;
+        for (int i = 0; i < list.length(); i++)
+        {
+            children[i].reset(moves[i], weight / total);
+            weight *= PRIOR_DECAY;
+        }
+
+        node->children.store(children, std::memory_order_relaxed);
+        node->n_children.store(list.length(), std::memory_order_relaxed);
+        node->state.store(NodeState::EXPANDED, std::memory_order_release);
+    }
+
+
+    bool MCTSTree::iteration(Position& position, Thread& thread)
+    {
+        MCTSNode* path[MAX_TREE_DEPTH + 1];
+        MCTSNode* node = &m_root;
+        int length = 0;
+
+        // Selection: descend the tree adding virtual losses along the path
+        bool draw = false;
+        node->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+        path[length++] = node;
+        while (node->state.load(std::memory_order_acquire) == NodeState::EXPANDED)
+        {
+            node = select(node);
+            node->virtual_loss.fetch_add(1, std::memory_order_relaxed);
+            path[length++] = node;
+            position.make_move(node->move);
+            thread.m_nodes_searched.fetch_add(1, std::memory_order_relaxed);
+
+            if (position.is_draw(true))
+            {
+                draw = true;
+                break;
+            }
+        }
+        Depth ply = length - 1;
+
+        // Expansion: leaves are expanded on their second visit, by a single thread
+        NodeState expected = NodeState::UNEXPANDED;
+        if (!draw &&
+            ply < MAX_TREE_DEPTH &&
+            (node == &m_root || node->visits.load(std::memory_order_relaxed) > 0) &&
+            m_n_nodes.load(std::memory_order_relaxed) < m_max_nodes &&
+            node->state.compare_exchange_strong(expected, NodeState::EXPANDING))
+            expand(node, position, thread, ply);
+
+        // Evaluation: leaf values come from a shallow alpha-beta search instead of a random playout,
+        // deepened each time the number of visits doubles so that leaves left unexpanded keep improving
+        double value = 0.5;
+        bool timeout = false;
+        if (node->state.load(std::memory_order_acquire) == NodeState::TERMINAL)
+            value = position.in_check() ? 0.0 : 0.5;
+        else if (!draw)
+        {
+            SearchData data(thread, ply, node->move);
+            data.prev_pv()[ply] = MOVE_NULL;
+            Depth depth = LEAF_DEPTH + static_cast<int>(std::log2(node->visits.load(std::memory_order_relaxed) + 1));
+            Score score = position.get_turn() == WHITE
+                        ? negamax<PV, WHITE>(position, depth, -SCORE_INFINITE, SCORE_INFINITE, data)
+                        : negamax<PV, BLACK>(position, depth, -SCORE_INFINITE, SCORE_INFINITE, data);
+            timeout = thread.timeout();
+            value = score_to_value(score);
+        }
+
+        // Backpropagation: each node stores the value for the side that played its move
+        for (int i = length - 1; i >= 0; i--)
+        {
+            value = 1.0 - value;
+            if (!timeout)
+            {
+                path[i]->value.fetch_add(static_cast<int64_t>(value * VALUE_UNIT), std::memory_order_relaxed);
+                path[i]->visits.fetch_add(1, std::memory_order_relaxed);
+            }
+            path[i]->virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+            if (i > 0)
+                position.unmake_move();
+        }
+
+        if (timeout)
+            return false;
+
+        // Depth statistics for the output
+        m_iterations.fetch_add(1, std::memory_order_relaxed);
+        m_depth_sum.fetch_add(length, std::memory_order_relaxed);
+        int max_depth = m_max_depth.load(std::memory_order_relaxed);
+        while (length > max_depth && !m_max_depth.compare_exchange_weak(max_depth, length));
+        return true;
+    }
+
+
+    void MCTSTree::update_pvs(Thread& thread, int n_pvs) const
+    {
+        if (m_root.state.load(std::memory_order_acquire) != NodeState::EXPANDED)
+            return;
+
+        // Root children sorted by number of visits
+        std::vector<const MCTSNode*> root_nodes;
+        const MCTSNode* children = m_root.children.load(std::memory_order_relaxed);
+        for (int i = 0; i < m_root.n_children.load(std::memory_order_relaxed); i++)
+            root_nodes.push_back(children + i);
+        std::stable_sort(root_nodes.begin(), root_nodes.end(), [](const MCTSNode* a, const MCTSNode* b)
+                         {
+                             return a->visits.load(std::memory_order_relaxed) > b->visits.load(std::memory_order_relaxed);
+                         });
+
+        uint64_t iterations = std::max(uint64_t(1), m_iterations.load(std::memory_order_relaxed));
+        Depth depth = std::clamp(m_depth_sum.load(std::memory_order_relaxed) / iterations, uint64_t(1), uint64_t(NUM_MAX_DEPTH - 1));
+        Depth seldepth = std::max(static_cast<int>(thread.m_seldepth), m_max_depth.load(std::memory_order_relaxed));
+        for (int iPv = 0; iPv < std::min(n_pvs, static_cast<int>(root_nodes.size())); iPv++)
+        {
+            MultiPVData& pv = thread.m_multiPV[iPv];
+            const MCTSNode* node = root_nodes[iPv];
+            pv.depth = depth;
+            pv.seldepth = seldepth;
+            pv.score = value_to_score(node->q(0.5));
+            pv.type = BoundType::EXACT;
+
+            // Principal variation: follow the most visited children
+            Move* m = pv.pv;
+            while (node && m < pv.pv + NUM_MAX_DEPTH - 1)
+            {
+                *(m++) = node->move;
+                const MCTSNode* next = nullptr;
+                if (node->state.load(std::memory_order_acquire) == NodeState::EXPANDED)
+                {
+                    const MCTSNode* child = node->children.load(std::memory_order_relaxed);
+                    for (int i = 0; i < node->n_children.load(std::memory_order_relaxed); i++)
+                        if (child[i].visits.load(std::memory_order_relaxed) > 0 &&
+                            (!next || child[i].visits.load(std::memory_order_relaxed) > next->visits.load(std::memory_order_relaxed)))
+                            next = child + i;
+                }
+                node = next;
+            }
+            *m = MOVE_NULL;
+        }
+    }
+
+
+    void MCTSTree::search(Position& position, Thread& thread, int n_pvs)
+    {
+        const Limits& limits = thread.limits();
+        thread.m_seldepth = 0;
+
+        Timer timer_output;
+        uint64_t last_depth = 0;
+        // The first iteration always runs so that the root gets expanded
+        while (iteration(position, thread) && !thread.timeout())
+        {
+            if (!thread.is_main())
+                continue;
+
+            // Output information each time the average depth increases, and then every second
+            uint64_t depth = m_depth_sum.load(std::memory_order_relaxed) / m_iterations.load(std::memory_order_relaxed);
+            if (depth > last_depth || timer_output.elapsed() > 1)
+            {
+                update_pvs(thread, n_pvs);
+                thread.output_pvs();
+                timer_output = Timer();
+                last_depth = depth;
+            }
+
+            // Depth-limited searches use the average depth of the tree
+            if (depth >= static_cast<uint64_t>(limits.depth) && !thread.pool().pondering())
+                break;
+        }
+
+        // Final output for the main thread
+        if (thread.is_main())
+        {
+            update_pvs(thread, n_pvs);
+            thread.output_pvs();
+        }
+    }
+
+
+    uint64_t MCTSTree::iterations() const
+    {
+        return m_iterations.load(std::memory_order_relaxed);
+    }
+
+
+    std::size_t MCTSTree::memory() const
+    {
+        std::size_t n_blocks = 0;
+        for (const auto& arena : m_arenas)
+            n_blocks += arena.blocks.size();
+        return n_blocks * BLOCK_SIZE * sizeof(MCTSNode);
+    }
+}
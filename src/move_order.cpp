@@ -106,10 +106,11 @@ constexpr MoveStage operator++(MoveStage& current)
 }
 
 
+template<Turn TURN>
 bool MoveOrder::hash_move(Move& move)
 {
     move = m_hash_move;
-    return m_position.board().legal(m_hash_move);
+    return m_position.board().legal<TURN>(m_hash_move);
 }
 
 
@@ -127,15 +128,23 @@ int MoveOrder::capture_score(Move move) const
 
 int MoveOrder::quiet_score(Move move) const
 {
-    // Quiets are scored based on:
-    // 1. Butterfly histories
-    // 2. Piece type-destination histories
-    PieceType piece = m_position.board().get_piece_at(move.from());
-    return m_histories.butterfly_score(move, m_position.get_turn())
-         + m_histories.piece_type_score(move, piece);
+    if (m_position.get_turn() == WHITE)
+        return quiet_score<WHITE>(move);
+    else
+        return quiet_score<BLACK>(move);
 }
 
 
+Move MoveOrder::next_move()
+{
+    if (m_position.get_turn() == WHITE)
+        return next_move<WHITE>();
+    else
+        return next_move<BLACK>();
+}
+
+
+template<Turn TURN>
 Move MoveOrder::next_move()
 {
     Move move;
@@ -144,15 +153,15 @@ Move MoveOrder::next_move()
         if (m_stage == MoveStage::HASH)
         {
             ++m_stage;
-            if (hash_move(move))
+            if (hash_move<TURN>(move))
                 return move;
         }
         else if (m_stage == MoveStage::CAPTURES_INIT)
         {
             ++m_stage;
             m_moves = m_position.move_list();
-            m_position.board().generate_moves(m_moves, MoveGenType::CAPTURES);
-            sort_moves<true>(m_moves);
+            m_position.board().generate_moves<TURN>(m_moves, MoveGenType::CAPTURES);
+            sort_moves<TURN, true>(m_moves);
             m_curr = m_moves.begin();
         }
         else if (m_stage == MoveStage::CAPTURES)
@@ -174,7 +183,7 @@ Move MoveOrder::next_move()
             ++m_stage;
             Move candidate = m_histories.countermove(m_prev_move);
             if (candidate != m_hash_move &&
-                m_position.board().legal(candidate))
+                m_position.board().legal<TURN>(candidate))
             {
                 m_countermove = candidate;
                 return m_countermove;
@@ -189,7 +198,7 @@ Move MoveOrder::next_move()
                 Move candidate = m_histories.get_killer(i, m_ply);
                 if (candidate != m_hash_move &&
                     candidate != m_countermove &&
-                    m_position.board().legal(candidate))
+                    m_position.board().legal<TURN>(candidate))
                 {
                     m_killer = candidate;
                     return m_killer;
@@ -200,8 +209,8 @@ Move MoveOrder::next_move()
         {
             ++m_stage;
             m_moves = m_position.move_list();
-            m_position.board().generate_moves(m_moves, MoveGenType::QUIETS);
-            sort_moves<false>(threshold_moves<false>(m_moves, -3000 * m_depth));
+            m_position.board().generate_moves<TURN>(m_moves, MoveGenType::QUIETS);
+            sort_moves<TURN, false>(threshold_moves<TURN, false>(m_moves, -3000 * m_depth));
             m_curr = m_moves.begin();
         }
         else if (m_stage == MoveStage::QUIET)
@@ -217,3 +226,7 @@ Move MoveOrder::next_move()
         }
     }
 }
+
+
+template Move MoveOrder::next_move<WHITE>();
+template Move MoveOrder::next_move<BLACK>();
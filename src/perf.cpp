@@ -0,0 +1,204 @@
+#include "../include/perf.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace Perf
+{
+    // Error of the last failed counter, shared by all threads
+    std::atomic_int last_errno(0);
+
+
+#if defined(__linux__)
+    constexpr uint64_t cache_event(uint64_t cache, uint64_t result)
+    {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+    }
+
+    constexpr uint32_t event_types[NUM_EVENTS] = {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE
+    };
+
+    constexpr uint64_t event_configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        cache_event(PERF_COUNT_HW_CACHE_L1D,  PERF_COUNT_HW_CACHE_RESULT_MISS),
+        cache_event(PERF_COUNT_HW_CACHE_LL,   PERF_COUNT_HW_CACHE_RESULT_MISS),
+        cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)
+    };
+#endif
+
+
+
+    Sample::Sample()
+    {
+        for (int i = 0; i < NUM_EVENTS; i++)
+        {
+            values[i] = 0;
+            valid[i] = false;
+        }
+    }
+
+
+    bool Sample::empty() const
+    {
+        for (int i = 0; i < NUM_EVENTS; i++)
+            if (valid[i])
+                return false;
+        return true;
+    }
+
+
+    Sample& Sample::operator+=(const Sample& other)
+    {
+        for (int i = 0; i < NUM_EVENTS; i++)
+        {
+            values[i] += other.values[i];
+            valid[i] = valid[i] || other.valid[i];
+        }
+        return *this;
+    }
+
+
+
+    Counters::Counters()
+        : m_opened(false)
+    {
+        for (int i = 0; i < NUM_EVENTS; i++)
+            m_fd[i] = -1;
+    }
+
+
+    Counters::~Counters()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < NUM_EVENTS; i++)
+            if (m_fd[i] >= 0)
+                close(m_fd[i]);
+#endif
+    }
+
+
+    bool Counters::start()
+    {
+#if defined(__linux__)
+        // Counters are opened once, on the thread that owns them
+        if (!m_opened)
+        {
+            m_opened = true;
+            for (int i = 0; i < NUM_EVENTS; i++)
+            {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = event_types[i];
+                attr.config = event_configs[i];
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                m_fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+                if (m_fd[i] < 0)
+                    last_errno.store(errno);
+            }
+        }
+
+        bool any = false;
+        for (int i = 0; i < NUM_EVENTS; i++)
+            if (m_fd[i] >= 0)
+            {
+                ioctl(m_fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(m_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+                any = true;
+            }
+        return any;
+#else
+        return false;
+#endif
+    }
+
+
+    void Counters::stop()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < NUM_EVENTS; i++)
+            if (m_fd[i] >= 0)
+                ioctl(m_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+
+    Sample Counters::read() const
+    {
+        Sample sample;
+#if defined(__linux__)
+        for (int i = 0; i < NUM_EVENTS; i++)
+        {
+            // Value, time enabled and time running: scale up if the PMU had to multiplex events
+            uint64_t data[3];
+            if (m_fd[i] < 0 || ::read(m_fd[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+                continue;
+
+            sample.values[i] = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+            sample.valid[i] = true;
+        }
+#endif
+        return sample;
+    }
+
+
+
+    std::string unavailable_reason()
+    {
+#if defined(__linux__)
+        int error = last_errno.load();
+        return error ? std::strerror(error) : "no events opened";
+#else
+        return "not supported on this platform";
+#endif
+    }
+
+
+    std::string report(const Sample& sample, uint64_t nodes, double elapsed)
+    {
+        std::ostringstream out;
+        out << "perf nodes " << nodes
+            << " nps " << static_cast<uint64_t>(nodes / std::max(elapsed, 1e-3));
+
+        if (sample.empty())
+        {
+            out << " counters unavailable (" << unavailable_reason() << ")";
+            return out.str();
+        }
+
+        const char* names[NUM_EVENTS] = { "cycles", "instructions", "branch-misses",
+                                          "l1d-misses", "llc-misses", "dtlb-misses" };
+        double n = std::max(nodes, uint64_t(1));
+        out << std::fixed << std::setprecision(2);
+        if (sample.valid[CYCLES] && sample.valid[INSTRUCTIONS] && sample.values[CYCLES] > 0)
+            out << " ipc " << static_cast<double>(sample.values[INSTRUCTIONS]) / sample.values[CYCLES];
+        for (int i = 0; i < NUM_EVENTS; i++)
+            if (sample.valid[i])
+                out << " " << names[i] << "/node " << sample.values[i] / n;
+
+        return out.str();
+    }
+}
@@ -1,4 +1,5 @@
 #include "../include/position.hpp"
+#include "../include/cpu.hpp"
 #include "../include/types.hpp"
 #include "../include/piece_square_tables.hpp"
 #include "../include/zobrist.hpp"
@@ -62,7 +63,8 @@ Board::Board()
 Board::Board(std::string fen)
     : m_hash(0),
       m_psq(0, 0),
-      m_phase(Phases::Total)
+      m_phase(Phases::Total),
+      m_threats_valid{ false, false }
 {
     auto c = fen.cbegin();
 
@@ -211,18 +213,28 @@ void Board::update_checkers()
 }
 
 
-void Board::generate_moves(MoveList& list, MoveGenType type) const
+// Multiversioned through a free function: member clones declared in the header emit a resolver in every
+// translation unit, which only links when the whole program goes through LTO (not in the library build)
+TARGET_CLONES
+static void generate_moves_dispatch(const Board& board, MoveList& list, MoveGenType type)
 {
-    if (m_turn == WHITE)
-        generate_moves<WHITE>(list, type);
+    if (board.turn() == WHITE)
+        board.generate_moves<WHITE>(list, type);
     else
-        generate_moves<BLACK>(list, type);
+        board.generate_moves<BLACK>(list, type);
+}
+
+
+void Board::generate_moves(MoveList& list, MoveGenType type) const
+{
+    generate_moves_dispatch(*this, list, type);
 }
 
 
 Board Board::make_move(Move move) const
 {
     Board result = *this;
+    result.m_threats_valid[WHITE] = result.m_threats_valid[BLACK] = false;
     const Direction up = (m_turn == WHITE) ? 8 : -8;
     const PieceType piece = get_piece_at(move.from());
 
@@ -307,6 +319,52 @@ Board Board::make_move(Move move) const
 }
 
 
+Hash Board::hash_after(Move move) const
+{
+    // The key updates of make_move, without building the new board
+    const Direction up = (m_turn == WHITE) ? 8 : -8;
+    const PieceType piece = get_piece_at(move.from());
+    Hash hash = m_hash ^ Zobrist::get_black_move();
+    if (m_enpassant_square != SQUARE_NULL)
+        hash ^= Zobrist::get_ep_file(file(m_enpassant_square));
+
+    // Castling rights lost with this move
+    bool lost[NUM_CASTLE_SIDES][NUM_COLORS] = {};
+    if (piece == KING)
+        lost[KINGSIDE][m_turn] = lost[QUEENSIDE][m_turn] = true;
+    else if (piece == ROOK)
+    {
+        lost[KINGSIDE][m_turn] = move.from() == (m_turn == WHITE ? SQUARE_H1 : SQUARE_H8);
+        lost[QUEENSIDE][m_turn] = move.from() == (m_turn == WHITE ? SQUARE_A1 : SQUARE_A8);
+    }
+
+    if (move.is_capture())
+    {
+        Square target = move.is_ep_capture() ? move.to() - up : move.to();
+        hash ^= Zobrist::get_piece_turn_square(get_piece_at(target), ~m_turn, target);
+        lost[KINGSIDE][~m_turn] = move.to() == (m_turn == WHITE ? SQUARE_H8 : SQUARE_H1);
+        lost[QUEENSIDE][~m_turn] = move.to() == (m_turn == WHITE ? SQUARE_A8 : SQUARE_A1);
+    }
+    else if (move.is_double_pawn_push())
+        hash ^= Zobrist::get_ep_file(file(move.to()));
+    else if (move.is_castle())
+    {
+        Square iS = move.to() + (move.to() > move.from() ? +1 : -2);
+        Square iE = move.to() + (move.to() > move.from() ? -1 : +1);
+        hash ^= Zobrist::get_piece_turn_square(ROOK, m_turn, iS) ^ Zobrist::get_piece_turn_square(ROOK, m_turn, iE);
+    }
+
+    for (auto side : { KINGSIDE, QUEENSIDE })
+        for (auto turn : { WHITE, BLACK })
+            if (lost[side][turn] && m_castling_rights[side][turn])
+                hash ^= Zobrist::get_castle_side_turn(side, turn);
+
+    PieceType placed = move.is_promotion() ? move.promo_piece() : piece;
+    return hash ^ Zobrist::get_piece_turn_square(piece, m_turn, move.from())
+                ^ Zobrist::get_piece_turn_square(placed, m_turn, move.to());
+}
+
+
 bool Board::is_valid() const
 {
     // Side not to move in check?
@@ -361,6 +419,7 @@ bool Board::is_valid() const
 
 Board Board::make_null_move()
 {
+    // Attack maps only depend on piece placement, so they are kept
     Board result = *this;
 
     // En-passant
@@ -456,49 +515,65 @@ Square Board::least_valuable(Bitboard bb) const
 }
 
 
+// Piece values for Static-Exchange evaluation
+constexpr Score see_piece_score[] = { 10, 30, 30, 50, 90, 1000, 0, 0 };
+
+
+template<Turn SIDE, int COLOR>
+bool see_capture(const Board& board, Square target, Bitboard& occupancy, PieceType& last_attacker, Score& gain)
+{
+    // Get attackers from this side
+    Bitboard attacks_target = board.attackers<SIDE>(target, occupancy) & occupancy;
+    if (!attacks_target)
+        return false;
+
+    // If the side to move is already ahead they can stop the capture sequence,
+    // so we can prune the remaining iterations
+    if (COLOR * gain > 0)
+        return false;
+
+    // Get least valuable attacker and make the capture
+    Square attacker = board.least_valuable(attacks_target);
+    gain += COLOR * see_piece_score[last_attacker];
+    last_attacker = board.get_piece_at(attacker);
+    occupancy ^= Bitboard::from_square(attacker);
+    return true;
+}
+
+
 Score Board::see(Move move, int threshold) const
 {
-    // Static-Exchange evaluation with pruning
-    constexpr Score piece_score[] = { 10, 30, 30, 50, 90, 1000, 0, 0 };
+    if (m_turn == WHITE)
+        return see<WHITE>(move, threshold);
+    else
+        return see<BLACK>(move, threshold);
+}
+
 
+template<Turn TURN>
+Score Board::see(Move move, int threshold) const
+{
+    // Static-Exchange evaluation with pruning
     Square target = move.to();
 
     // Make the initial capture
     PieceType last_attacker = get_piece_at(move.from());
-    Score gain = piece_score[move.is_ep_capture() ? PAWN : get_piece_at(target)] - threshold / 10;
-    Bitboard from_bb = Bitboard::from_square(move.from());
-    Bitboard occupancy = get_pieces() ^ from_bb;
-    Turn side_to_move = ~m_turn;
-    int color = -1;
-
-    // Iterate over opponent attackers
-    Bitboard attacks_target = attackers(target, occupancy, side_to_move) & occupancy;
-    while (attacks_target)
-    {
-        // If the side to move is already ahead they can stop the capture sequence,
-        // so we can prune the remaining iterations
-        if (color * gain > 0)
-            return 10 * gain;
-
-        // Get least valuable attacker
-        Square attacker = least_valuable(attacks_target);
-        Bitboard attacker_bb = Bitboard::from_square(attacker);
-
-        // Make the capture
-        gain += color * piece_score[last_attacker];
-        last_attacker = get_piece_at(attacker);
-        occupancy ^= attacker_bb;
-        side_to_move = ~side_to_move;
-        color = -color;
-
-        // Get opponent attackers
-        attacks_target = attackers(target, occupancy, side_to_move) & occupancy;
-    }
+    Score gain = see_piece_score[move.is_ep_capture() ? PAWN : get_piece_at(target)] - threshold / 10;
+    Bitboard occupancy = get_pieces() ^ Bitboard::from_square(move.from());
+
+    // Iterate over attackers: two captures per iteration to keep the side to move known at compile-time
+    while (see_capture<~TURN, -1>(*this, target, occupancy, last_attacker, gain) &&
+           see_capture< TURN, +1>(*this, target, occupancy, last_attacker, gain))
+    {}
 
     return 10 * gain;
 }
 
 
+template Score Board::see<WHITE>(Move move, int threshold) const;
+template Score Board::see<BLACK>(Move move, int threshold) const;
+
+
 MixedScore Board::material_eval() const
 {
     return m_psq;
@@ -511,6 +586,16 @@ uint8_t Board::phase() const
 }
 
 
+bool Board::legal(Move move) const
+{
+    if (m_turn == WHITE)
+        return legal<WHITE>(move);
+    else
+        return legal<BLACK>(move);
+}
+
+
+template<Turn TURN>
 bool Board::legal(Move move) const
 {
     // Same source and destination squares?
@@ -526,7 +611,7 @@ bool Board::legal(Move move) const
         return false;
 
     // Source square is not ours or destination ours?
-    Bitboard our_pieces = (m_turn == WHITE ? get_pieces<WHITE>() : get_pieces<BLACK>());
+    Bitboard our_pieces = get_pieces<TURN>();
     if (!our_pieces.test(move.from()) || our_pieces.test(move.to()))
         return false;
 
@@ -550,22 +635,26 @@ bool Board::legal(Move move) const
 
     Bitboard occupancy = get_pieces();
     if (piece == PAWN)
-        return legal<PAWN>(move, occupancy);
+        return legal<TURN, PAWN>(move, occupancy);
     else if (piece == KNIGHT)
-        return legal<KNIGHT>(move, occupancy);
+        return legal<TURN, KNIGHT>(move, occupancy);
     else if (piece == BISHOP)
-        return legal<BISHOP>(move, occupancy);
+        return legal<TURN, BISHOP>(move, occupancy);
     else if (piece == ROOK)
-        return legal<ROOK>(move, occupancy);
+        return legal<TURN, ROOK>(move, occupancy);
     else if (piece == QUEEN)
-        return legal<QUEEN>(move, occupancy);
+        return legal<TURN, QUEEN>(move, occupancy);
     else if (piece == KING)
-        return legal<KING>(move, occupancy);
+        return legal<TURN, KING>(move, occupancy);
     else
         return false;
 }
 
 
+template bool Board::legal<WHITE>(Move move) const;
+template bool Board::legal<BLACK>(Move move) const;
+
+
 Bitboard Board::non_pawn_material() const
 {
     return get_pieces<WHITE, KNIGHT>() | get_pieces<BLACK, KNIGHT>()
@@ -577,11 +666,9 @@ Bitboard Board::non_pawn_material() const
 Bitboard Board::non_pawn_material(Turn turn) const
 {
     if (turn == WHITE)
-        return get_pieces<WHITE, KNIGHT>() | get_pieces<WHITE, BISHOP>()
-             | get_pieces<WHITE, ROOK  >() | get_pieces<WHITE, QUEEN>();
+        return non_pawn_material<WHITE>();
     else
-        return get_pieces<BLACK, KNIGHT>() | get_pieces<BLACK, BISHOP>()
-             | get_pieces<BLACK, ROOK  >() | get_pieces<BLACK, QUEEN>();
+        return non_pawn_material<BLACK>();
 }
 
 
@@ -644,6 +731,18 @@ bool Position::is_draw(bool unique) const
 }
 
 
+bool Position::repeats(Hash hash) const
+{
+    // Positions with the side to move of the child, since the last irreversible move
+    int cur_pos = (int)m_boards.size() - 1;
+    int min_pos = std::max(0, cur_pos - board().half_move_clock());
+    for (int pos = cur_pos - 1; pos >= min_pos; pos -= 2)
+        if (m_boards[pos].hash() == hash)
+            return true;
+    return false;
+}
+
+
 bool Position::in_check() const
 {
     return board().checkers();
@@ -757,6 +856,36 @@ bool Position::reduced() const
 }
 
 
+bool Position::same_state(const Position& other) const
+{
+    if (hash() != other.hash() || board().half_move_clock() != other.board().half_move_clock())
+        return false;
+
+    // Boards since the last irreversible move decide repetitions, so they must match too
+    int n = std::min(board().half_move_clock(), (int)m_boards.size() - 1);
+    int n_other = std::min(board().half_move_clock(), (int)other.m_boards.size() - 1);
+    if (n != n_other)
+        return false;
+
+    for (int i = 1; i <= n; i++)
+        if (m_boards[m_boards.size() - 1 - i].hash() != other.m_boards[other.m_boards.size() - 1 - i].hash())
+            return false;
+    return true;
+}
+
+
+Move Position::last_move() const
+{
+    return m_moves.empty() ? MOVE_NULL : m_moves.back().move;
+}
+
+
+std::size_t Position::memory() const
+{
+    return m_boards.capacity() * sizeof(Board) + m_stack.memory() + m_moves.capacity() * sizeof(MoveInfo);
+}
+
+
 std::ostream& operator<<(std::ostream& out, const Board& board)
 {
     out << "   +------------------------+\n";
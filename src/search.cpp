@@ -1,4 +1,6 @@
 #include "../include/types.hpp"
+#include "../include/cluster.hpp"
+#include "../include/cpu.hpp"
 #include "../include/move.hpp"
 #include "../include/position.hpp"
 #include "../include/hash.hpp"
@@ -8,12 +10,53 @@
 #include "../include/uci.hpp"
 #include "../include/zobrist.hpp"
 #include "../include/thread.hpp"
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <vector>
 
 namespace Search
 {
+    // Natural logarithm for constant expressions: ln(x) = k ln(2) + 2 atanh(y), with x / 2^k in [1, 2)
+    constexpr double constexpr_log(double x)
+    {
+        int k = 0;
+        while (x >= 2)
+        {
+            x /= 2;
+            k++;
+        }
+
+        double y = (x - 1) / (x + 1);
+        double term = y;
+        double sum = 0;
+        for (int n = 1; n < 40; n += 2)
+        {
+            sum += term / n;
+            term *= y * y;
+        }
+        return k * 0.6931471805599453 + 2 * sum;
+    }
+
+
+    // Late move reductions by depth and move number, growing with the logarithm of both
+    constexpr int LMR_SIZE = 64;
+    constexpr auto LMR_TABLE = []()
+    {
+        std::array<std::array<uint8_t, LMR_SIZE>, LMR_SIZE> table{};
+        for (int depth = 1; depth < LMR_SIZE; depth++)
+            for (int move_number = 1; move_number < LMR_SIZE; move_number++)
+                table[depth][move_number] = static_cast<uint8_t>(1.0 + constexpr_log(depth) * constexpr_log(move_number) / 2.0);
+        return table;
+    }();
+
+
+    // Enhanced transposition cutoffs: minimum depth and number of children probed
+    constexpr Depth ETC_DEPTH = 4;
+    constexpr int ETC_MOVES = 4;
+
+
+
     Timer::Timer()
     {
         m_start = std::chrono::steady_clock::now();
@@ -38,9 +81,22 @@ namespace Search
 
     SearchTime::SearchTime() noexcept
         : m_managed(false),
-          m_end_time(std::chrono::steady_clock::now())
+          m_end_time(std::chrono::steady_clock::now()),
+          m_nodes_per_ms(0),
+          m_end_nodes_ms(0)
     {}
 
+    void SearchTime::set_nodes_time(int nodes_per_ms, std::function<uint64_t()> nodes)
+    {
+        m_nodes_per_ms = nodes_per_ms;
+        m_nodes = nodes;
+    }
+
+    double SearchTime::nodes_ms() const
+    {
+        return static_cast<double>(m_nodes()) / m_nodes_per_ms;
+    }
+
     void SearchTime::init(const Timer& timer, bool ponder)
     {
         m_timer = timer;
@@ -55,13 +111,20 @@ namespace Search
         m_movetime_ms = movetime_ms;
         m_pondering.store(ponder);
         m_end_time.store(m_timer.begin() + std::chrono::milliseconds(movetime_ms));
+
+        // Node counters are reset when the threads start searching
+        m_end_nodes_ms.store(movetime_ms);
     }
 
     void SearchTime::ponderhit()
     {
         m_pondering.store(false);
         if (m_managed)
+        {
             m_end_time.store(std::chrono::steady_clock::now() + std::chrono::milliseconds(m_movetime_ms));
+            if (m_nodes_per_ms > 0)
+                m_end_nodes_ms.store(nodes_ms() + m_movetime_ms);
+        }
     }
 
     bool SearchTime::pondering() const
@@ -74,12 +137,21 @@ namespace Search
         return m_timer.elapsed();
     }
 
+    double SearchTime::used() const
+    {
+        return m_nodes_per_ms > 0 ? nodes_ms() / 1000 : elapsed();
+    }
+
     double SearchTime::remaining() const
     {
         // Return infinite remaining time if pondering or if search is not time managed
         if (pondering() || !time_management())
             return std::numeric_limits<double>::infinity();
 
+        // Node-based time: the nodes searched so far stand for the elapsed time
+        if (m_nodes_per_ms > 0)
+            return (m_end_nodes_ms.load(std::memory_order_relaxed) - nodes_ms()) / 1000;
+
         // Remaining time is always the difference between now and the end time
         return Timer::diff(m_end_time.load(std::memory_order_relaxed),
                            std::chrono::steady_clock::now());
@@ -92,6 +164,38 @@ namespace Search
 
 
 
+    SearchStats::SearchStats()
+        : probcut_nodes(0),
+          probcut_captures(0),
+          probcut_cutoffs(0),
+          etc_nodes(0),
+          etc_probes(0),
+          etc_cutoffs(0),
+          qsearch_nodes(0),
+          qsearch_ply_cutoffs(0),
+          qsearch_limited_evasions(0),
+          qsearch_max_ply(0),
+          qsearch_max_checks(0)
+    {}
+
+    SearchStats& SearchStats::operator+=(const SearchStats& other)
+    {
+        probcut_nodes += other.probcut_nodes;
+        probcut_captures += other.probcut_captures;
+        probcut_cutoffs += other.probcut_cutoffs;
+        etc_nodes += other.etc_nodes;
+        etc_probes += other.etc_probes;
+        etc_cutoffs += other.etc_cutoffs;
+        qsearch_nodes += other.qsearch_nodes;
+        qsearch_ply_cutoffs += other.qsearch_ply_cutoffs;
+        qsearch_limited_evasions += other.qsearch_limited_evasions;
+        qsearch_max_ply = std::max(qsearch_max_ply, other.qsearch_max_ply);
+        qsearch_max_checks = std::max(qsearch_max_checks, other.qsearch_max_checks);
+        return *this;
+    }
+
+
+
     MultiPVData::MultiPVData()
         : depth(0),
           seldepth(0),
@@ -100,7 +204,7 @@ namespace Search
     {
     }
 
-    void MultiPVData::write_pv(int index, uint64_t nodes, double elapsed) const
+    void MultiPVData::write_pv(int index, uint64_t nodes, double elapsed, int hashfull) const
     {
         // Don't write if PV line is incomplete
         if (type == BoundType::NO_BOUND)
@@ -124,7 +228,7 @@ namespace Search
         // Nodes, nps, hashful and timing
         std::cout << " nodes "    << nodes;
         std::cout << " nps "      << static_cast<int>(nodes / elapsed);
-        std::cout << " hashfull " << ttable.hashfull();
+        std::cout << " hashfull " << hashfull;
         std::cout << " time "     << std::max(1, static_cast<int>(elapsed * 1000));
 
         // Pv line
@@ -138,11 +242,11 @@ namespace Search
 
 
 
-    SearchData::SearchData(Thread& thread)
-        : m_ply(0), m_extensions(0), m_prev(nullptr), m_thread(thread), m_move(MOVE_NULL),
+    SearchData::SearchData(Thread& thread, int ply, Move last_move)
+        : m_ply(ply), m_extensions(0), m_prev(nullptr), m_thread(thread), m_move(last_move),
           m_pv(thread.m_pv.pv), m_prev_pv(thread.m_pv.prev_pv), m_isPv(true), 
           seldepth(thread.m_seldepth), static_eval(SCORE_NONE), excluded_move(MOVE_NULL),
-          histories(thread.m_histories)
+          histories(thread.m_histories), qsearch_ply(0), qsearch_checks(0)
     {}
 
     int SearchData::extensions() const { return m_extensions; }
@@ -176,8 +280,9 @@ namespace Search
 
     const SearchData* SearchData::previous(int distance) const
     {
+        // Searches started away from the root (MCTS leaves) have no ancestors: return nullptr past the first one
         const SearchData* curr = this;
-        for (int i = 0; i < distance; i++)
+        for (int i = 0; i < distance && curr; i++)
             curr = curr->m_prev;
         return curr;
     }
@@ -230,12 +335,20 @@ namespace Search
     {
         Thread& thread = data.thread();
 
-        constexpr Score starting_window = 25;
+        // Parallel aspiration: helpers start from staggered windows, alternating wider and narrower
+        // than the main thread, and follow exact root scores published by the other threads
+        const bool parallel = UCI::Options::ParallelAspiration && UCI::Options::MultiPV == 1 && thread.group() == 0;
+        constexpr Score window_scale[] = { 4, 8, 2, 16 };
+        Score starting_window = parallel ? window_scale[thread.id() % 4] * 25 / 4 : 25;
         Score l_window = starting_window;
         Score r_window = starting_window;
+        bool resynced = false;
 
-        // Initial windows
+        // Initial windows (possibly around a deeper exact score found by another thread)
         Score init_score = pv.score;
+        Score shared_score;
+        if (parallel && depth > 4 && thread.pool().shared_root_score(depth - 1, shared_score))
+            init_score = shared_score;
         Score alpha = (depth <= 4) ? (-SCORE_INFINITE) : std::max(-SCORE_INFINITE, (init_score - l_window));
         Score beta  = (depth <= 4) ? ( SCORE_INFINITE) : std::min(+SCORE_INFINITE, (init_score + r_window));
 
@@ -254,7 +367,8 @@ namespace Search
             copy_pv(pv.pv, data.prev_pv());
 
             // Do the search
-            score = negamax<ROOT>(position, depth, alpha, beta, data);
+            score = position.get_turn() == WHITE ? negamax<ROOT, WHITE>(position, depth, alpha, beta, data)
+                                                 : negamax<ROOT, BLACK>(position, depth, alpha, beta, data);
 
             // Check for timeout: search results cannot be trusted
             if (thread.timeout())
@@ -271,7 +385,11 @@ namespace Search
 
             // We can exit if this score is exact
             if (pv.type == BoundType::EXACT)
+            {
+                if (parallel)
+                    thread.pool().publish_root_score(depth, score);
                 return score;
+            }
 
             // Output failed search after some time
             if (thread.is_main() && thread.time().elapsed() > 3 && UCI::Options::MultiPV == 1)
@@ -282,6 +400,14 @@ namespace Search
             else
                 r_window *= 2;
 
+            // After a score jump, recenter once on an exact score another thread found at this depth
+            if (parallel && !resynced && thread.pool().shared_root_score(depth, shared_score))
+            {
+                resynced = true;
+                init_score = shared_score;
+                l_window = r_window = starting_window;
+            }
+
             // Increase window in the failed side exponentially (without overflowing)
             alpha = std::max(((init_score - l_window) > init_score) ? (-SCORE_INFINITE) : (init_score - l_window), -SCORE_INFINITE);
             beta  = std::min(((init_score + r_window) < init_score) ? (+SCORE_INFINITE) : (init_score + r_window), +SCORE_INFINITE);
@@ -292,7 +418,104 @@ namespace Search
 
 
 
-    template<SearchType ST>
+    Score mtdf_search(Position& position, MultiPVData& pv, Depth depth, SearchData& data)
+    {
+        Thread& thread = data.thread();
+
+        // Passes before switching from MTD(f) steps to bisection of the bounds, which avoids
+        // crawling towards the minimax value one centipawn at a time
+        constexpr int max_mtdf_passes = 4;
+
+        // The previous iteration's score is our first guess
+        int guess = (pv.type == BoundType::NO_BOUND) ? 0 : pv.score;
+        int lower = -SCORE_INFINITE;
+        int upper = +SCORE_INFINITE;
+
+        for (int pass = 0; lower < upper; pass++)
+        {
+            // Null window test: is the score at least beta?
+            int beta = (pass >= max_mtdf_passes && lower > -SCORE_INFINITE && upper < SCORE_INFINITE)
+                     ? lower + (upper - lower + 1) / 2
+                     : std::max(guess, lower + 1);
+
+            data.clear_pv();
+            data.seldepth = 0;
+            copy_pv(pv.pv, data.prev_pv());
+
+            Score score = position.get_turn() == WHITE ? negamax<ROOT, WHITE>(position, depth, beta - 1, beta, data)
+                                                       : negamax<ROOT, BLACK>(position, depth, beta - 1, beta, data);
+
+            // Check for timeout: search results cannot be trusted
+            if (thread.timeout())
+                return score;
+
+            // Narrow the bounds. Only fail highs have a move proving the score, so the Pv line
+            // of the last one is kept for the final result
+            guess = score;
+            if (score < beta)
+                upper = score;
+            else
+            {
+                lower = score;
+                copy_pv(data.pv(), pv.pv);
+            }
+
+            pv.depth = depth;
+            pv.score = score;
+            pv.seldepth = (pass == 0) ? data.seldepth : std::max(pv.seldepth, data.seldepth);
+            pv.type = (lower >= upper) ? BoundType::EXACT
+                    : (score < beta)   ? BoundType::UPPER_BOUND
+                    :                    BoundType::LOWER_BOUND;
+
+            // Output bounds after some time
+            if (pv.type != BoundType::EXACT &&
+                thread.is_main() && thread.time().elapsed() > 3 && UCI::Options::MultiPV == 1)
+                thread.output_pvs();
+        }
+
+        return pv.score;
+    }
+
+
+
+    Score full_window_search(Position& position, MultiPVData& pv, Depth depth, SearchData& data)
+    {
+        // Exact score of the root moves of the thread, without aspiration, as used by the root move
+        // partitioning where each search covers a single root move
+        data.clear_pv();
+        data.seldepth = 0;
+        copy_pv(pv.pv, data.prev_pv());
+
+        Score alpha = -SCORE_INFINITE;
+        Score beta = SCORE_INFINITE;
+        Score score = position.get_turn() == WHITE ? negamax<ROOT, WHITE>(position, depth, alpha, beta, data)
+                                                   : negamax<ROOT, BLACK>(position, depth, alpha, beta, data);
+
+        // Check for timeout: search results cannot be trusted
+        if (data.thread().timeout())
+            return score;
+
+        pv.depth = depth;
+        pv.score = score;
+        pv.seldepth = data.seldepth;
+        pv.type = BoundType::EXACT;
+        copy_pv(data.pv(), pv.pv);
+        return score;
+    }
+
+
+
+    // Tree dump record of the current node, or of one of its moves
+    inline void log_tree(SearchData& data, TreeLog::Event event, SearchType st, Move move, Depth depth,
+                         Score alpha, Score beta, Score score, uint8_t flags)
+    {
+        data.thread().tree_log().write(event, data.ply(), move, st, depth, alpha, beta, score, flags);
+    }
+
+
+
+    template<SearchType ST, Turn TURN>
+    TARGET_CLONES
     Score negamax(Position& position, Depth depth, Score alpha, Score beta, SearchData& data)
     {
         // Node data
@@ -300,8 +523,11 @@ namespace Search
         constexpr bool RootSearch = ST == ROOT;
         const bool HasExcludedMove = data.excluded_move != MOVE_NULL;
         const bool InCheck = position.in_check();
-        const Turn Turn = position.get_turn();
         const Depth Ply = data.ply();
+        const bool Logging = data.thread().tree_log().enabled(Ply);
+        const Score AlphaIn = alpha;
+        const Score BetaIn = beta;
+        uint8_t log_flags = (InCheck ? TreeLog::IN_CHECK : 0) | (HasExcludedMove ? TreeLog::EXCLUDED_MOVE : 0);
 
         if (PvNode)
         {
@@ -320,19 +546,28 @@ namespace Search
             alpha = std::max(alpha, static_cast<Score>(-SCORE_MATE + Ply));
             beta  = std::min(beta,  static_cast<Score>( SCORE_MATE - Ply + 1));
             if (alpha >= beta)
+            {
+                if (Logging)
+                    log_tree(data, TreeLog::MATE_DISTANCE, ST, data.last_move(), depth, AlphaIn, BetaIn, alpha, log_flags);
                 return alpha;
+            }
         }
 
         // Dive into quiescence at leaf nodes
         if (depth <= 0)
-            return quiescence<ST>(position, alpha, beta, data);
+            return quiescence<ST, TURN>(position, alpha, beta, data);
 
         // Early check for draw or maximum depth reached
         if (position.is_draw(!RootSearch) ||
             Ply >= NUM_MAX_PLY)
+        {
+            if (Logging)
+                log_tree(data, TreeLog::DRAW, ST, data.last_move(), depth, AlphaIn, BetaIn, SCORE_DRAW, log_flags);
             return SCORE_DRAW;
+        }
 
         // TT lookup
+        HashTable<TranspositionEntry>& ttable = data.thread().pool().tt();
         Score alpha_init = alpha;
         Depth tt_depth = 0;
         Move tt_move = MOVE_NULL;
@@ -342,8 +577,16 @@ namespace Search
         EntryType tt_type = EntryType::EXACT;
         Hash hash = HasExcludedMove ? position.hash() ^ Zobrist::get_move_hash(data.excluded_move) : position.hash();
         bool tt_hit = ttable.query(hash, &entry);
+        if (!tt_hit && UCI::Options::QSearchHash && !HasExcludedMove &&
+            data.thread().qsearch_table().query(hash, &entry))
+        {
+            // Shallow qsearch results only provide a move and static evaluation
+            tt_move = entry->hash_move();
+            tt_static_eval = entry->static_eval();
+        }
         if (tt_hit)
         {
+            log_flags |= TreeLog::TT_HIT;
             tt_type = entry->type();
             tt_depth = entry->depth();
             tt_score = score_from_tt(entry->score(), Ply);
@@ -361,14 +604,18 @@ namespace Search
                 {
                     PieceType piece = position.board().get_piece_at(tt_move.from());
                     if (tt_score >= beta)
-                        data.histories.fail_high(tt_move, data.last_move(), Turn, depth, Ply, piece);
+                        data.histories.fail_high(tt_move, data.last_move(), TURN, depth, Ply, piece);
                     else
-                        data.histories.add_bonus(tt_move, Turn, piece, -depth);
+                        data.histories.add_bonus(tt_move, TURN, piece, -depth);
                 }
 
                 // Do not cutoff when we are approaching the 50 move rule
                 if (position.board().half_move_clock() < 90)
+                {
+                    if (Logging)
+                        log_tree(data, TreeLog::TT_CUTOFF, ST, data.last_move(), depth, AlphaIn, BetaIn, tt_score, log_flags);
                     return tt_score;
+                }
             }
         }
 
@@ -379,15 +626,21 @@ namespace Search
             // We don't recompute static eval if
             // 1. We have a valid TT hit
             // 2. Previous move was a null-move
-            if (tt_hit && tt_static_eval != SCORE_NONE)
+            if (tt_static_eval != SCORE_NONE)
                 static_eval = tt_static_eval;
-            else if (data.last_move() == MOVE_NULL && Ply > 1)
+            else if (data.last_move() == MOVE_NULL && Ply > 1 && data.previous(1))
                 static_eval = -data.previous(1)->static_eval;
             else
-                static_eval = turn_to_color(Turn) * evaluate<false>(position);
+                static_eval = turn_to_color(TURN) * evaluate<false>(position);
         }
         data.static_eval = static_eval;
 
+        // Is our static evaluation better than on our previous move?
+        const SearchData* prev_data = data.previous(2);
+        const bool Improving = !InCheck && prev_data &&
+                               prev_data->static_eval != SCORE_NONE &&
+                               static_eval > prev_data->static_eval;
+
         // Can we use the TT value for a better static evaluation?
         if (tt_hit && tt_score != SCORE_NONE &&
             ((tt_type == EntryType::EXACT) ||
@@ -400,23 +653,128 @@ namespace Search
         {
             Score margin = 200 * depth;
             if (static_eval - margin >= beta)
+            {
+                if (Logging)
+                    log_tree(data, TreeLog::FUTILITY, ST, data.last_move(), depth, AlphaIn, BetaIn, static_eval, log_flags);
                 return static_eval;
+            }
+        }
+
+        // Enhanced transposition cutoff: a child whose stored upper bound is below -beta refutes this
+        // node without a search. The entries of the first ordered children are prefetched together,
+        // and the most promising one is tried first when the node has no hash move. Children that
+        // repeat a position are skipped, as their stored scores ignore the draw.
+        Move etc_move = MOVE_NULL;
+        if (UCI::Options::ETC &&
+            !PvNode && !HasExcludedMove &&
+            depth >= ETC_DEPTH &&
+            position.board().half_move_clock() < 90)
+        {
+            Search::SearchStats& stats = data.thread().stats();
+            stats.etc_nodes++;
+
+            Move etc_moves[ETC_MOVES];
+            Hash etc_keys[ETC_MOVES];
+            int n_children = 0;
+            MoveOrder orderer = MoveOrder(position, Ply, depth, tt_move, data.histories, data.last_move());
+            Move move;
+            while (n_children < ETC_MOVES && (move = orderer.next_move<TURN>()) != MOVE_NULL)
+            {
+                Hash key = position.board().hash_after(move);
+                if (position.repeats(key))
+                    continue;
+                etc_moves[n_children] = move;
+                etc_keys[n_children] = key;
+                ttable.prefetch(key);
+                n_children++;
+            }
+
+            Score etc_bound = -SCORE_INFINITE;
+            for (int i = 0; i < n_children; i++)
+            {
+                TranspositionEntry* child = nullptr;
+                stats.etc_probes++;
+                if (!ttable.query(etc_keys[i], &child) || child->type() == EntryType::LOWER_BOUND)
+                    continue;
+
+                Score score = -score_from_tt(child->score(), Ply + 1);
+                if (child->depth() >= depth - 1 && score >= beta)
+                {
+                    stats.etc_cutoffs++;
+                    ttable.store(hash, depth, score_to_tt(score, Ply), etc_moves[i], EntryType::LOWER_BOUND, data.static_eval);
+                    if (Logging)
+                        log_tree(data, TreeLog::ETC, ST, data.last_move(), depth, AlphaIn, BetaIn, score, log_flags);
+                    return score;
+                }
+
+                if (score > etc_bound)
+                {
+                    etc_bound = score;
+                    etc_move = etc_moves[i];
+                }
+            }
         }
 
         // Null move pruning
         if (!PvNode && !InCheck && !HasExcludedMove &&
             static_eval >= beta &&
             data.last_move() != MOVE_NULL &&
-            position.board().non_pawn_material(Turn))
+            position.board().non_pawn_material<TURN>())
         {
             int reduction = 3 + (static_eval - beta) / 200;
             Depth new_depth = reduce(depth, 1 + reduction);
             SearchData curr_data = data.next(MOVE_NULL);
             position.make_null_move();
-            Score null = -negamax<NON_PV>(position, new_depth, -beta, -beta + 1, curr_data);
+            Score null = -negamax<NON_PV, ~TURN>(position, new_depth, -beta, -beta + 1, curr_data);
             position.unmake_null_move();
             if (null >= beta)
-                return null < SCORE_MATE_FOUND ? null : beta;
+            {
+                Score score = null < SCORE_MATE_FOUND ? null : beta;
+                if (Logging)
+                    log_tree(data, TreeLog::NULL_MOVE, ST, data.last_move(), depth, AlphaIn, BetaIn, score, log_flags);
+                return score;
+            }
+        }
+
+        // ProbCut: if a good capture beats beta by a margin in a reduced search, we can expect the
+        // full-depth search to fail high as well. Captures are verified by a qsearch first.
+        const Score ProbCutBeta = std::min(beta + 150, SCORE_MATE_FOUND - 1);
+        if (UCI::Options::ProbCut &&
+            !PvNode && !InCheck && !HasExcludedMove &&
+            depth >= 5 &&
+            abs(beta) < SCORE_MATE_FOUND - 150 &&
+            !(tt_hit && tt_depth >= depth - 3 && tt_score < ProbCutBeta))
+        {
+            Search::SearchStats& stats = data.thread().stats();
+            stats.probcut_nodes++;
+
+            Depth probcut_depth = depth - 4;
+            Move probcut_move = tt_move.is_capture() ? tt_move : MOVE_NULL;
+            MoveOrder orderer = MoveOrder(position, Ply, 0, probcut_move, data.histories, MOVE_NULL, true);
+            Move move;
+            while ((move = orderer.next_move<TURN>()) != MOVE_NULL)
+            {
+                // Only captures winning enough material to reach the ProbCut bound
+                if (position.board().see<TURN>(move, ProbCutBeta - static_eval) < 0)
+                    continue;
+
+                stats.probcut_captures++;
+                position.make_move(move);
+                SearchData curr_data = data.next(move);
+                Score score = -quiescence<NON_PV, ~TURN>(position, -ProbCutBeta, -ProbCutBeta + 1, curr_data);
+                if (score >= ProbCutBeta)
+                    score = -negamax<NON_PV, ~TURN>(position, probcut_depth, -ProbCutBeta, -ProbCutBeta + 1, curr_data);
+                position.unmake_move();
+
+                if (score >= ProbCutBeta && score < SCORE_MATE_FOUND)
+                {
+                    stats.probcut_cutoffs++;
+                    ttable.store(hash, probcut_depth + 1, score_to_tt(score, Ply), move, EntryType::LOWER_BOUND, data.static_eval);
+                    if (Logging)
+                        log_tree(data, TreeLog::PROBCUT, ST, data.last_move(), depth, AlphaIn, BetaIn, score, log_flags);
+                    return score;
+                }
+            }
         }
 
         // TT-based reduction idea
@@ -431,9 +789,10 @@ namespace Search
         Score best_score = -SCORE_INFINITE;
         Move quiet_list[NUM_MAX_MOVES];
         MoveList quiets_searched(quiet_list);
-        Move hash_move = (data.in_pv() && data.pv_move() != MOVE_NULL) ? data.pv_move() : tt_move;
+        Move hash_move = (data.in_pv() && data.pv_move() != MOVE_NULL) ? data.pv_move()
+                       : tt_move != MOVE_NULL ? tt_move : etc_move;
         MoveOrder orderer = MoveOrder(position, Ply, depth, hash_move, data.histories, data.last_move());
-        while ((move = orderer.next_move()) != MOVE_NULL)
+        while ((move = orderer.next_move<TURN>()) != MOVE_NULL)
         {
             n_moves++;
             if (!move.is_capture() && !move.is_promotion())
@@ -456,29 +815,37 @@ namespace Search
 
             // Output some information during search
             if (RootSearch && data.thread().is_main() &&
+                !data.thread().pool().has_listeners() &&
+                !data.thread().pool().root_split() &&
                 data.thread().time().elapsed() > 3)
                 std::cout << "info depth " << static_cast<int>(depth)
                           << " currmove " << move.to_uci()
                           << " currmovenumber " << n_moves << std::endl;
 
             // Shallow depth prunings
-            if (!RootSearch && position.board().non_pawn_material(Turn) && !InCheck && best_score > -SCORE_MATE_FOUND)
+            if (!RootSearch && position.board().non_pawn_material<TURN>() && !InCheck && best_score > -SCORE_MATE_FOUND)
             {
+                TreeLog::Event pruned = TreeLog::NUM_EVENTS;
                 if (move.is_capture() || move.is_promotion())
                 {
-                    if (depth < 7 && position.board().see(move, -200 * depth) < 0)
-                        continue;
+                    if (depth < 7 && position.board().see<TURN>(move, -200 * depth) < 0)
+                        pruned = TreeLog::PRUNE_SEE_CAPTURE;
                 }
                 else
                 {
                     if (depth < 7 && n_moves > 3 + depth * depth)
-                        continue;
-
-                    if (depth < 5 && orderer.quiet_score(move) < -3000 * (depth - 1))
-                        continue;
+                        pruned = TreeLog::PRUNE_MOVE_COUNT;
+                    else if (depth < 5 && orderer.quiet_score<TURN>(move) < -3000 * (depth - 1))
+                        pruned = TreeLog::PRUNE_HISTORY;
+                    else if (depth < 7 && position.board().see<TURN>(move, -20 * (depth + (int)depth * depth)) < 0)
+                        pruned = TreeLog::PRUNE_SEE_QUIET;
+                }
 
-                    if (depth < 7 && position.board().see(move, -20 * (depth + (int)depth * depth)) < 0)
-                        continue;
+                if (pruned != TreeLog::NUM_EVENTS)
+                {
+                    if (Logging)
+                        log_tree(data, pruned, ST, move, depth, alpha, beta, best_score, log_flags);
+                    continue;
                 }
             }
 
@@ -500,18 +867,22 @@ namespace Search
 
                 // Search with the move excluded
                 data.excluded_move = move;
-                Score score = negamax<NON_PV>(position, singularDepth, singularBeta - 1, singularBeta, data);
+                Score score = negamax<NON_PV, TURN>(position, singularDepth, singularBeta - 1, singularBeta, data);
                 data.excluded_move = MOVE_NULL;
 
                 if (score < singularBeta)
                 {
                     // TT move is singular, we are extending it
                     extension = 1;
+                    if (Logging)
+                        log_tree(data, TreeLog::SINGULAR_EXTENSION, ST, move, depth, singularBeta - 1, singularBeta, score, log_flags);
                 }
                 else if (singularBeta >= beta)
                 {
                     // Multi-cut pruning: assuming our TT move fails high, at least one more move also fails high
                     // So we can probably safely prune the entire tree
+                    if (Logging)
+                        log_tree(data, TreeLog::MULTI_CUT, ST, data.last_move(), depth, AlphaIn, BetaIn, singularBeta, log_flags);
                     return singularBeta;
                 }
             }
@@ -520,6 +891,7 @@ namespace Search
             Score score;
             bool captureOrPromotion = move.is_capture() || move.is_promotion();
             PieceType piece = static_cast<PieceType>(position.board().get_piece_at(move.from()));
+            int history = captureOrPromotion ? 0 : orderer.quiet_score<TURN>(move);
             position.make_move(move);
 
             // Check extensions
@@ -533,20 +905,34 @@ namespace Search
             // Late move reductions
             bool do_full_search = true;
             bool didLMR = false;
-            if (depth > 4 &&
+            if (depth >= 3 &&
                 move_number > 3 &&
                 (!PvNode || !captureOrPromotion) &&
                 data.thread().id() % 3 < 2)
             {
                 didLMR = true;
-                int reduction = 3 + (move_number - 4) / 8 - captureOrPromotion - PvNode;
-                Depth new_depth = reduce(depth, 1 + reduction);
+                int reduction = LMR_TABLE[std::min<int>(depth, LMR_SIZE - 1)][std::min(move_number, LMR_SIZE - 1)]
+                              - captureOrPromotion;
+
+                // Adjustments, each of which can be switched off for testing: reduce less in PV nodes and
+                // for quiets with good histories, more when the position is not improving
+                if (UCI::Options::LMRNodeType)
+                    reduction -= PvNode;
+                if (UCI::Options::LMRHistory)
+                    reduction -= std::clamp(history / 5000, -2, 2);
+                if (UCI::Options::LMRImproving)
+                    reduction += !Improving;
+
+                Depth new_depth = reduce(depth, 1 + std::max(0, reduction));
 
                 // Reduced depth search
-                score = -negamax<NON_PV>(position, new_depth, -alpha - 1, -alpha, curr_data);
+                score = -negamax<NON_PV, ~TURN>(position, new_depth, -alpha - 1, -alpha, curr_data);
 
                 // Only carry a full search if this reduced move fails high
                 do_full_search = score >= alpha;
+                if (Logging)
+                    log_tree(data, do_full_search ? TreeLog::LMR_RESEARCH : TreeLog::LMR, ST, move, new_depth,
+                             alpha, alpha + 1, score, log_flags);
             }
 
             // PVS
@@ -554,10 +940,11 @@ namespace Search
             {
                 if (PvNode && n_moves == 1)
                 {
-                    score = -negamax<PV>(position, curr_depth - 1, -beta, -alpha, curr_data);
+                    score = -negamax<PV, ~TURN>(position, curr_depth - 1, -beta, -alpha, curr_data);
 
-                    // Return failed aspirated search immediately
-                    if (RootSearch && (score <= alpha || score >= beta))
+                    // Return failed aspirated search immediately (null window root searches of the MTD(f)
+                    // driver still need the other moves to prove a fail low)
+                    if (RootSearch && (score >= beta || (score <= alpha && beta - alpha > 1)))
                     {
                         position.unmake_move();
                         data.update_pv(move, curr_data.pv());
@@ -567,13 +954,16 @@ namespace Search
                 else
                 {
                     // Regular non-PV node search
-                    score = -negamax<NON_PV>(position, curr_depth - 1, -alpha - 1, -alpha, curr_data);
+                    score = -negamax<NON_PV, ~TURN>(position, curr_depth - 1, -alpha - 1, -alpha, curr_data);
                     // Redo a PV node search if move not refuted
                     if (PvNode && score > alpha && score < beta)
                     {
+                        if (Logging)
+                            log_tree(data, TreeLog::PVS_RESEARCH, ST, move, curr_depth - 1, alpha, beta, score, log_flags);
+
                         // But before add a bonus to the move
-                        data.histories.add_bonus(move, Turn, piece, depth);
-                        score = -negamax<PV>(position, curr_depth - 1, -beta, -alpha, curr_data);
+                        data.histories.add_bonus(move, TURN, piece, depth);
+                        score = -negamax<PV, ~TURN>(position, curr_depth - 1, -beta, -alpha, curr_data);
                     }
                 }
             }
@@ -589,7 +979,7 @@ namespace Search
             if (didLMR && do_full_search)
             {
                 int bonus = score > best_score ? depth : -depth;
-                data.histories.add_bonus(move, Turn, piece, bonus);
+                data.histories.add_bonus(move, TURN, piece, bonus);
             }
 
             // New best move
@@ -609,7 +999,7 @@ namespace Search
             {
                 data.update_pv(best_move, nullptr);
                 if (!move.is_capture())
-                    data.histories.fail_high(move, data.last_move(), Turn, depth, Ply, piece);
+                    data.histories.fail_high(move, data.last_move(), TURN, depth, Ply, piece);
                 break;
             }
         }
@@ -618,7 +1008,7 @@ namespace Search
         if (best_score >= alpha)
             for (auto move : quiets_searched)
                 if (move != best_move)
-                    data.histories.add_bonus(move, Turn, position.board().get_piece_at(move.from()), -depth * depth / 4);
+                    data.histories.add_bonus(move, TURN, position.board().get_piece_at(move.from()), -depth * depth / 4);
 
         // Check for game end
         if (n_moves == 0)
@@ -630,27 +1020,32 @@ namespace Search
                 best_score = SCORE_DRAW;
         }
 
-        // TT store (except at root in non-main threads)
-        if (!(RootSearch && !data.thread().is_main()))
+        // TT store (except at root in non-main threads, or when the root moves are split over the threads)
+        if (!(RootSearch && (!data.thread().is_main() || data.thread().pool().root_split())))
         {
             Hash hash = HasExcludedMove ? position.hash() ^ Zobrist::get_move_hash(data.excluded_move) : position.hash();
             EntryType type = best_score >= beta                  ? EntryType::LOWER_BOUND
                            : (PvNode && best_score > alpha_init) ? EntryType::EXACT
                            :                                       EntryType::UPPER_BOUND;
             ttable.store(hash, depth, score_to_tt(best_score, Ply), best_move, type, data.static_eval);
+
+            // Deep entries are also sent to the other processes of a cluster
+            Cluster::share(hash, depth, score_to_tt(best_score, Ply), best_move, type, data.static_eval);
         }
 
+        if (Logging)
+            log_tree(data, TreeLog::NODE, ST, data.last_move(), depth, AlphaIn, BetaIn, best_score, log_flags);
         return best_score;
     }
 
 
 
-    template<SearchType ST>
+    template<SearchType ST, Turn TURN>
+    TARGET_CLONES
     Score quiescence(Position& position, Score alpha, Score beta, SearchData& data)
     {
         constexpr bool PvNode = ST == PV;
         const bool InCheck = position.in_check();
-        const Turn Turn = position.get_turn();
         const Depth Ply = data.ply();
 
         if (PvNode)
@@ -665,20 +1060,38 @@ namespace Search
             Ply >= NUM_MAX_PLY)
             return SCORE_DRAW;
 
+        // Quiescence statistics, with the plies below the horizon and the number of consecutive checks
+        // against the side to move on this line
+        SearchStats& stats = data.thread().stats();
+        stats.qsearch_nodes++;
+        stats.qsearch_max_ply = std::max<int>(stats.qsearch_max_ply, data.qsearch_ply);
+        data.qsearch_checks = !InCheck ? 0 : data.qsearch_ply >= 2 ? data.previous(2)->qsearch_checks + 1 : 1;
+
+        // Ply budget: lines going too far past the horizon are cut with the static evaluation
+        if (UCI::Options::QSearchPlies && data.qsearch_ply >= UCI::Options::QSearchPlies)
+        {
+            stats.qsearch_ply_cutoffs++;
+            return turn_to_color(TURN) * evaluate<false>(position);
+        }
+
         // Mate distance pruning: don't bother searching if we are deeper than the shortest mate up to this point
         alpha = std::max(alpha, static_cast<Score>(-SCORE_MATE + Ply));
         beta = std::min(beta, static_cast<Score>(SCORE_MATE - Ply + 1));
         if (alpha >= beta)
             return alpha;
 
-        // TT lookup
+        // TT lookup (qsearch entries may live in the per-thread table)
+        HashTable<TranspositionEntry>& ttable = data.thread().pool().tt();
         Score alpha_init = alpha;
         Move tt_move = MOVE_NULL;
         Score tt_score = SCORE_NONE;
         Score tt_static_eval = SCORE_NONE;
         TranspositionEntry* entry = nullptr;
         EntryType tt_type = EntryType::EXACT;
-        bool tt_hit = ttable.query(position.hash(), &entry);
+        const bool ThreadHash = UCI::Options::QSearchHash;
+        HashTable<TranspositionEntry>& qtable = ThreadHash ? data.thread().qsearch_table() : ttable;
+        bool tt_hit = ttable.query(position.hash(), &entry) ||
+                      (ThreadHash && qtable.query(position.hash(), &entry));
         if (tt_hit)
         {
             tt_type = entry->type();
@@ -709,7 +1122,7 @@ namespace Search
             if (tt_hit && tt_static_eval != SCORE_NONE)
                 static_eval = tt_static_eval;
             else
-                static_eval = turn_to_color(Turn) * evaluate<false>(position);
+                static_eval = turn_to_color(TURN) * evaluate<false>(position);
             best_score = static_eval;
 
             // Can we use the TT value for a better static evaluation?
@@ -729,30 +1142,46 @@ namespace Search
         Move move;
         int n_moves = 0;
         Move best_move = MOVE_NULL;
+        bool limited_evasions = false;
         MoveOrder orderer = MoveOrder(position, Ply, 0, tt_move, data.histories, MOVE_NULL, true);
-        while ((move = orderer.next_move()) != MOVE_NULL)
+        while ((move = orderer.next_move<TURN>()) != MOVE_NULL)
         {
+            // After a series of checks only the hash move and the capturing evasions are searched: the first
+            // quiet evasion ends the loop, which also tells that the position is not checkmate
+            if (InCheck && UCI::Options::QSearchChecks && data.qsearch_checks > UCI::Options::QSearchChecks &&
+                move != tt_move && !move.is_capture())
+            {
+                limited_evasions = true;
+                stats.qsearch_limited_evasions++;
+                break;
+            }
+
             n_moves++;
 
+            // Longest series of checks answered by a quiet evasion of the move orderer
+            if (InCheck && move != tt_move && !move.is_capture())
+                stats.qsearch_max_checks = std::max<int>(stats.qsearch_max_checks, data.qsearch_checks);
+
             // Only search captures with positive SEE
-            if (!InCheck && position.board().see(move) < 0)
+            if (!InCheck && position.board().see<TURN>(move) < 0)
                 continue;
 
             // PVS
             Score score;
             position.make_move(move);
             SearchData curr_data = data.next(move);
+            curr_data.qsearch_ply = data.qsearch_ply + 1;
             if (PvNode && best_move == MOVE_NULL)
             {
-                score = -quiescence<PV>(position, -beta, -alpha, curr_data);
+                score = -quiescence<PV, ~TURN>(position, -beta, -alpha, curr_data);
             }
             else
             {
                 // Regular non-PV node search
-                score = -quiescence<NON_PV>(position, -alpha - 1, -alpha, curr_data);
+                score = -quiescence<NON_PV, ~TURN>(position, -alpha - 1, -alpha, curr_data);
                 // Redo a PV node search if move not refuted
                 if (PvNode && score > alpha && score < beta)
-                    score = -quiescence<PV>(position, -beta, -alpha, curr_data);
+                    score = -quiescence<PV, ~TURN>(position, -beta, -alpha, curr_data);
             }
             position.unmake_move();
 
@@ -773,20 +1202,31 @@ namespace Search
             }
         }
 
-        // Checkmate?
+        // Checkmate? Without the quiet evasions we can only fall back to the static evaluation
         if (n_moves == 0 && InCheck)
-            return -SCORE_MATE + Ply;
+        {
+            if (!limited_evasions)
+                return -SCORE_MATE + Ply;
+            best_score = turn_to_color(TURN) * evaluate<false>(position);
+        }
 
-        // TT store
+        // TT store. With the quiet evasions skipped, only a fail high of a searched move bounds the score
+        if (limited_evasions && (n_moves == 0 || best_score < beta))
+            return best_score;
         EntryType type = best_score >= beta                  ? EntryType::LOWER_BOUND
                        : (PvNode && best_score > alpha_init) ? EntryType::EXACT
                        :                                       EntryType::UPPER_BOUND;
-        ttable.store(position.hash(), 0, score_to_tt(best_score, Ply), best_move, type, static_eval);
+        qtable.store(position.hash(), 0, score_to_tt(best_score, Ply), best_move, type, static_eval);
 
         return best_score;
     }
 
 
+    // Full-window searches are also used as MCTS leaf evaluations
+    template Score negamax<PV, WHITE>(Position& position, Depth depth, Score alpha, Score beta, SearchData& data);
+    template Score negamax<PV, BLACK>(Position& position, Depth depth, Score alpha, Score beta, SearchData& data);
+
+
 
     bool legality_tests(Position& position, MoveList& move_list)
     {
@@ -818,4 +1258,40 @@ namespace Search
         }
         return final;
     }
+
+
+
+    int64_t parallel_perft(ThreadPool& pool, const Position& position, Depth depth, bool output)
+    {
+        Position root = position;
+        auto move_list = root.generate_moves(MoveGenType::LEGAL);
+        std::vector<Move> moves(move_list.begin(), move_list.end());
+        if (depth <= 1)
+        {
+            if (output)
+                for (auto move : moves)
+                    std::cout << move.to_uci() << ": " << 1 << std::endl;
+            return moves.size();
+        }
+
+        // One task per root move, each on its own copy of the position
+        std::vector<int64_t> counts(moves.size(), 0);
+        bool complete = pool.parallel_for(0, moves.size(), [&](int i)
+        {
+            Position copy = position;
+            copy.make_move(moves[i]);
+            counts[i] = perft<false>(copy, depth - 1);
+        });
+        if (!complete)
+            return -1;
+
+        int64_t n_nodes = 0;
+        for (std::size_t i = 0; i < moves.size(); i++)
+        {
+            n_nodes += counts[i];
+            if (output)
+                std::cout << moves[i].to_uci() << ": " << counts[i] << std::endl;
+        }
+        return n_nodes;
+    }
 }
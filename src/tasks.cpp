@@ -0,0 +1,93 @@
+#include "../include/tasks.hpp"
+#include <atomic>
+
+
+namespace Tasks
+{
+    WaitGroup::WaitGroup()
+        : m_pending(0)
+    {}
+
+
+    void WaitGroup::add(int count)
+    {
+        m_pending.fetch_add(count, std::memory_order_relaxed);
+    }
+
+
+    void WaitGroup::done()
+    {
+        m_pending.fetch_sub(1, std::memory_order_release);
+    }
+
+
+    bool WaitGroup::finished() const
+    {
+        return m_pending.load(std::memory_order_acquire) == 0;
+    }
+
+
+
+    Deque::Deque()
+        : m_top(0),
+          m_bottom(0)
+    {
+        for (auto& task : m_tasks)
+            task.store(nullptr, std::memory_order_relaxed);
+    }
+
+
+    bool Deque::push(Task* task)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        if (bottom - top >= CAPACITY)
+            return false;
+
+        m_tasks[bottom % CAPACITY].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+
+    Task* Deque::pop()
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        // Empty deque
+        if (top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        // With a single task left, race the thieves for it
+        Task* task = m_tasks[bottom % CAPACITY].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                task = nullptr;
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+
+    Task* Deque::steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return nullptr;
+
+        Task* task = m_tasks[top % CAPACITY].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return task;
+    }
+}
@@ -2,10 +2,19 @@
 #include "../include/position.hpp"
 #include "../include/search.hpp"
 #include "../include/tests.hpp"
+#include "../include/thread.hpp"
 #include "../include/types.hpp"
+#include "../include/uci.hpp"
+#include "../include/tasks.hpp"
+#include <atomic>
+#include <chrono>
+#include <ctime>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
 
 namespace Tests
 {
@@ -165,11 +174,19 @@ namespace Tests
     {
         auto tests = test_suite();
 
+        // Positions are counted in parallel, then reported in order
+        std::vector<int64_t> results(tests.size());
+        pool->parallel_for(0, tests.size(), [&](int i)
+        {
+            Position pos(tests[i].fen());
+            results[i] = Search::perft<false>(pos, tests[i].depth());
+        });
+
         int n_failed = 0;
-        for (auto& test : tests)
+        for (std::size_t i = 0; i < tests.size(); i++)
         {
-            Position pos(test.fen());
-            auto result = Search::perft<false>(pos, test.depth());
+            auto& test = tests[i];
+            auto result = results[i];
             if (result == test.result())
             {
                 std::cout << "[ OK ] " << test.fen() << " (" << result << ")" << std::endl;
@@ -217,4 +234,464 @@ namespace Tests
         std::cout << "\nFailed/total tests: " << n_failed << "/" << tests.size() << std::endl;
         return n_failed;
     }
+
+
+    template<Turn TURN>
+    bool valid_threats(const Board& board)
+    {
+        // Threats are the squares with an attacker once the enemy king is removed from the occupancy
+        Bitboard occupancy = board.get_pieces() ^ board.get_pieces<~TURN, KING>();
+        for (int square = 0; square < NUM_SQUARES; square++)
+            if (board.threats<TURN>().test(square) != static_cast<bool>(board.attackers<TURN>(static_cast<Square>(square), occupancy)))
+                return false;
+        return true;
+    }
+
+
+    int threat_tests()
+    {
+        auto tests = test_suite();
+
+        int n_failed = 0;
+        for (auto& test : tests)
+        {
+            // The position, its children and their null moves (which keep the attack maps)
+            Position pos(test.fen());
+            std::vector<Board> boards = { pos.board(), Board(pos.board()).make_null_move() };
+            for (Move move : pos.generate_moves(MoveGenType::LEGAL))
+            {
+                Board child = pos.board().make_move(move);
+                boards.push_back(child);
+                boards.push_back(Board(child).make_null_move());
+            }
+
+            int result = 0;
+            for (auto& board : boards)
+                if (valid_threats<WHITE>(board) && valid_threats<BLACK>(board))
+                    result++;
+
+            if (result == (int)boards.size())
+            {
+                std::cout << "[ OK ] " << test.fen() << " (" << result << ")" << std::endl;
+            }
+            else
+            {
+                std::cout << "[FAIL] " << test.fen() << " (ref " << boards.size() << ", new " << result << ")" << std::endl;
+                n_failed++;
+            }
+        }
+
+        std::cout << "\nFailed/total tests: " << n_failed << "/" << tests.size() << std::endl;
+        return n_failed;
+    }
+
+
+    int64_t hash_after_errors(Position& pos, Depth depth, int64_t& n_moves)
+    {
+        // Compare the predicted key of each move with the one of the board it leads to
+        int64_t n_errors = 0;
+        for (Move move : pos.generate_moves(MoveGenType::LEGAL))
+        {
+            n_moves++;
+            Hash predicted = pos.board().hash_after(move);
+            pos.make_move(move);
+            if (predicted != pos.hash())
+                n_errors++;
+            if (depth > 1)
+                n_errors += hash_after_errors(pos, depth - 1, n_moves);
+            pos.unmake_move();
+        }
+        return n_errors;
+    }
+
+
+    int hash_tests()
+    {
+        auto tests = test_suite();
+
+        int n_failed = 0;
+        for (auto& test : tests)
+        {
+            Position pos(test.fen());
+            int64_t n_moves = 0;
+            int64_t n_errors = hash_after_errors(pos, 4, n_moves);
+
+            if (n_errors == 0)
+            {
+                std::cout << "[ OK ] " << test.fen() << " (" << n_moves << ")" << std::endl;
+            }
+            else
+            {
+                std::cout << "[FAIL] " << test.fen() << " (" << n_errors << " of " << n_moves << " moves)" << std::endl;
+                n_failed++;
+            }
+        }
+
+        std::cout << "\nFailed/total tests: " << n_failed << "/" << tests.size() << std::endl;
+        return n_failed;
+    }
+
+
+    bool check_counts(const std::string& name, const std::vector<std::atomic_int>& counts)
+    {
+        // Every index must have been processed exactly once
+        int n_wrong = 0;
+        for (auto& count : counts)
+            n_wrong += count != 1;
+
+        if (n_wrong == 0)
+            std::cout << "[ OK ] " << name << " (" << counts.size() << ")" << std::endl;
+        else
+            std::cout << "[FAIL] " << name << " (" << n_wrong << " of " << counts.size() << " wrong)" << std::endl;
+        return n_wrong == 0;
+    }
+
+
+    int task_tests()
+    {
+        int n_failed = 0;
+        int n_tests = 0;
+
+        // Work-stealing deque: the owner pushes and pops while other threads steal. Pushes beyond the
+        // capacity fail, so the owner pops a task whenever the deque is full.
+        {
+            constexpr int N_TASKS = 100000;
+            constexpr int N_THIEVES = 3;
+            std::vector<Tasks::Task> tasks(N_TASKS);
+            std::vector<std::atomic_int> counts(N_TASKS);
+            for (auto& count : counts)
+                count = 0;
+            auto run = [&](Tasks::Task* task) { counts[task - tasks.data()]++; };
+
+            Tasks::Deque deque;
+            std::atomic_bool done(false);
+            std::vector<std::thread> thieves;
+            for (int i = 0; i < N_THIEVES; i++)
+                thieves.emplace_back([&]()
+                {
+                    while (!done)
+                        if (Tasks::Task* task = deque.steal())
+                            run(task);
+                });
+
+            for (int i = 0; i < N_TASKS; i++)
+            {
+                while (!deque.push(&tasks[i]))
+                    if (Tasks::Task* task = deque.pop())
+                        run(task);
+                if (i % 3 == 0)
+                    if (Tasks::Task* task = deque.pop())
+                        run(task);
+            }
+            while (Tasks::Task* task = deque.pop())
+                run(task);
+            done = true;
+            for (auto& thief : thieves)
+                thief.join();
+
+            n_tests++;
+            n_failed += !check_counts("deque", counts);
+        }
+
+        // Parallel loops on several threads, with nested loops spawned from the workers
+        {
+            int n_threads = pool->size();
+            pool->resize(4);
+
+            constexpr int N = 64;
+            std::vector<std::atomic_int> counts(N * N);
+            for (auto& count : counts)
+                count = 0;
+            bool completed = pool->parallel_for(0, N, [&](int i)
+            {
+                pool->parallel_for(N * i, N * (i + 1), [&](int j) { counts[j]++; });
+            });
+
+            n_tests++;
+            n_failed += !check_counts("parallel_for", counts) || !completed;
+            pool->resize(n_threads);
+        }
+
+        std::cout << "\nFailed/total tests: " << n_failed << "/" << n_tests << std::endl;
+        return n_failed;
+    }
+
+
+    Move silent_search(const std::string& fen, const Search::Limits& limits)
+    {
+        // Searches from a clean state with the output captured, returning the best move
+        Move bestmove = MOVE_NULL;
+        SearchListeners listeners;
+        listeners.info = [](int index, const Search::MultiPVData& pv, uint64_t nodes, double elapsed, int hashfull) {};
+        listeners.bestmove = [&bestmove](Move move, Move ponder) { bestmove = move; };
+        pool->set_listeners(listeners);
+        pool->clear();
+        pool->position() = Position(fen);
+        pool->update_position_threads();
+        pool->search(Search::Timer(), limits, true);
+        pool->set_listeners(SearchListeners());
+        return bestmove;
+    }
+
+
+    int search_tests()
+    {
+        // Keep the current position and search mode to restore them at the end
+        Position position = pool->position();
+        std::string search_mode = UCI::Options::SearchMode;
+
+        Search::Limits limits;
+        limits.nodes = 20000;
+
+        // Short searches in each mode must return a legal move
+        int n_failed = 0;
+        int n_tests = 0;
+        for (std::string mode : { "AlphaBeta", "MCTS" })
+        {
+            UCI::Options::SearchMode = mode;
+            for (auto& fen : bench_suite())
+            {
+                Move bestmove = silent_search(fen, limits);
+
+                n_tests++;
+                if (bestmove != MOVE_NULL && pool->position().board().legal(bestmove))
+                {
+                    std::cout << "[ OK ] " << mode << " " << fen << " (" << bestmove.to_uci() << ")" << std::endl;
+                }
+                else
+                {
+                    std::cout << "[FAIL] " << mode << " " << fen << " (" << bestmove.to_uci() << ")" << std::endl;
+                    n_failed++;
+                }
+            }
+        }
+
+        // Restore previous state
+        UCI::Options::SearchMode = search_mode;
+        pool->position() = position;
+        pool->update_position_threads();
+
+        std::cout << "\nFailed/total tests: " << n_failed << "/" << n_tests << std::endl;
+        return n_failed;
+    }
+
+
+    int qsearch_tests()
+    {
+        // Keep the current position and limits to restore them at the end
+        Position position = pool->position();
+        int max_plies = UCI::Options::QSearchPlies;
+        int max_checks = UCI::Options::QSearchChecks;
+
+        // Tight limits, so that both apply in the bench positions and in a few series of checks
+        constexpr int PLIES = 4;
+        constexpr int CHECKS = 1;
+        UCI::Options::QSearchPlies = PLIES;
+        UCI::Options::QSearchChecks = CHECKS;
+
+        std::vector<std::string> fens = bench_suite();
+        fens.push_back("6k1/5p1p/6p1/8/8/1q6/5PPP/3Q2K1 w - - 0 1");
+        fens.push_back("r5k1/5ppp/8/8/8/8/q4PPP/2QR2K1 b - - 0 1");
+
+        Search::Limits limits;
+        limits.depth = 6;
+
+        int n_failed = 0;
+        Search::SearchStats total;
+        for (auto& fen : fens)
+        {
+            silent_search(fen, limits);
+            Search::SearchStats stats = pool->stats();
+            total += stats;
+
+            if (stats.qsearch_max_ply <= PLIES && stats.qsearch_max_checks <= CHECKS)
+            {
+                std::cout << "[ OK ] " << fen << " (" << stats.qsearch_nodes << ")" << std::endl;
+            }
+            else
+            {
+                std::cout << "[FAIL] " << fen << " (" << static_cast<int>(stats.qsearch_max_ply) << " plies, "
+                          << static_cast<int>(stats.qsearch_max_checks) << " checks)" << std::endl;
+                n_failed++;
+            }
+        }
+
+        // The limits must have been reached for the checks above to mean anything
+        if (total.qsearch_ply_cutoffs == 0 || total.qsearch_limited_evasions == 0)
+        {
+            std::cout << "[FAIL] limits never reached (" << total.qsearch_ply_cutoffs << " ply cutoffs, "
+                      << total.qsearch_limited_evasions << " limited evasions)" << std::endl;
+            n_failed++;
+        }
+
+        // Restore previous state
+        UCI::Options::QSearchPlies = max_plies;
+        UCI::Options::QSearchChecks = max_checks;
+        pool->position() = position;
+        pool->update_position_threads();
+
+        std::cout << "\nFailed/total tests: " << n_failed << "/" << fens.size() << std::endl;
+        return n_failed;
+    }
+
+
+    int analysis_tests()
+    {
+        // Without a limit, analyzegame must search to its default depth. A search without bounds would
+        // only end when stopped, so the pool is stopped after a deadline and the test fails.
+        constexpr double DEADLINE = 30;
+        std::atomic_bool finished(false);
+        std::thread analysis([&finished]()
+        {
+            UCI::Stream stream("startpos moves e2e4 e7e5 g1f3");
+            UCI::analyzegame(stream);
+            finished = true;
+        });
+
+        Search::Timer timer;
+        while (!finished && timer.elapsed() < DEADLINE)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        bool timed_out = !finished;
+        while (!finished)
+        {
+            pool->stop();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        analysis.join();
+
+        if (!timed_out)
+            std::cout << "[ OK ] analyzegame without limit (" << static_cast<int>(timer.elapsed() * 1000) << " ms)" << std::endl;
+        else
+            std::cout << "[FAIL] analyzegame without limit (stopped after " << DEADLINE << " s)" << std::endl;
+
+        std::cout << "\nFailed/total tests: " << timed_out << "/1" << std::endl;
+        return timed_out;
+    }
+
+
+    std::vector<std::string> bench_suite()
+    {
+        std::vector<std::string> fens;
+
+        fens.push_back("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        fens.push_back("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10");
+        fens.push_back("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11");
+        fens.push_back("4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19");
+        fens.push_back("rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14");
+        fens.push_back("r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14");
+        fens.push_back("r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15");
+        fens.push_back("r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13");
+        fens.push_back("r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16");
+        fens.push_back("4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17");
+        fens.push_back("2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11");
+        fens.push_back("r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16");
+        fens.push_back("3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22");
+        fens.push_back("6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1");
+        fens.push_back("3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1");
+        fens.push_back("8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 80");
+
+        return fens;
+    }
+
+
+    void bench(int depth)
+    {
+        // Keep the current position to restore it at the end
+        Position position = pool->position();
+
+        Search::Limits limits;
+        limits.depth = depth;
+
+        uint64_t nodes = 0;
+        Search::SearchStats stats;
+        Search::Timer timer;
+        std::clock_t cpu_start = std::clock();
+        for (auto& fen : bench_suite())
+        {
+            // Each search starts from a clean state
+            pool->clear();
+            pool->position() = Position(fen);
+            pool->update_position_threads();
+            pool->search(Search::Timer(), limits, true);
+            nodes += pool->nodes_searched();
+            stats += pool->stats();
+        }
+        double elapsed = timer.elapsed();
+        double cpu = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+        std::cout << "\nBench summary" << std::endl;
+        std::cout << "  Positions: " << bench_suite().size() << std::endl;
+        std::cout << "  Depth:     " << depth << std::endl;
+        std::cout << "  Nodes:     " << nodes << std::endl;
+        std::cout << "  Time (ms): " << static_cast<int>(elapsed * 1000) << std::endl;
+        std::cout << "  CPU (ms):  " << static_cast<int>(cpu * 1000) << std::endl;
+        std::cout << "  NPS:       " << static_cast<uint64_t>(nodes / elapsed) << std::endl;
+        std::cout << "  ProbCut:   " << stats.probcut_nodes << " nodes, " << stats.probcut_captures << " captures, "
+                  << stats.probcut_cutoffs << " cutoffs" << std::endl;
+        std::cout << "  ETC:       " << stats.etc_nodes << " nodes, " << stats.etc_probes << " probes, "
+                  << stats.etc_cutoffs << " cutoffs" << std::endl;
+        std::cout << "  QSearch:   " << stats.qsearch_nodes << " nodes ("
+                  << static_cast<double>(stats.qsearch_nodes) / std::max<uint64_t>(nodes - stats.qsearch_nodes, 1)
+                  << " per main node), max " << static_cast<int>(stats.qsearch_max_ply) << " plies, "
+                  << stats.qsearch_ply_cutoffs << " ply cutoffs, " << stats.qsearch_limited_evasions
+                  << " limited evasions" << std::endl;
+
+        // Restore previous state
+        pool->position() = position;
+        pool->update_position_threads();
+    }
+
+
+    void scaling(int movetime, int max_threads)
+    {
+        // Keep the current state to restore it at the end
+        Position position = pool->position();
+        std::string mode = UCI::Options::SearchMode;
+
+        Search::Limits limits;
+        limits.movetime = movetime;
+
+        std::vector<std::string> results;
+        for (std::string search_mode : { "AlphaBeta", "MCTS" })
+        {
+            UCI::Options::SearchMode = search_mode;
+            double base_nps = 0;
+            for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+            {
+                pool->resize(n_threads);
+
+                uint64_t nodes = 0;
+                Search::Timer timer;
+                for (auto& fen : bench_suite())
+                {
+                    pool->clear();
+                    pool->position() = Position(fen);
+                    pool->update_position_threads();
+                    pool->search(Search::Timer(), limits, true);
+                    nodes += pool->nodes_searched();
+                }
+                double nps = nodes / timer.elapsed();
+                if (n_threads == 1)
+                    base_nps = nps;
+
+                std::ostringstream line;
+                line << "  " << std::setw(9) << std::left << search_mode
+                     << " threads " << std::setw(4) << n_threads
+                     << " nodes " << std::setw(12) << nodes
+                     << " nps " << std::setw(10) << static_cast<uint64_t>(nps)
+                     << " speedup " << std::fixed << std::setprecision(2) << nps / base_nps;
+                results.push_back(line.str());
+            }
+        }
+
+        std::cout << "\nScaling summary (" << bench_suite().size() << " positions, " << movetime << " ms each)" << std::endl;
+        for (auto& line : results)
+            std::cout << line << std::endl;
+
+        // Restore previous state
+        UCI::Options::SearchMode = mode;
+        pool->resize(UCI::Options::Threads);
+        pool->position() = position;
+        pool->update_position_threads();
+    }
 }
@@ -1,12 +1,15 @@
 #include "../include/types.hpp"
+#include "../include/cluster.hpp"
 #include "../include/move.hpp"
 #include "../include/position.hpp"
 #include "../include/hash.hpp"
 #include "../include/move_order.hpp"
 #include "../include/thread.hpp"
 #include "../include/uci.hpp"
+#include "../include/evaluation.hpp"
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -17,14 +20,24 @@
 ThreadPool* pool;
 
 
+// Pool thread running tasks on the current thread, if any
+thread_local Thread* t_worker = nullptr;
+
+
 Thread::Thread(int id, ThreadPool& pool)
     : m_id(id),
       m_pool(pool),
-      m_status(ThreadStatus::WAITING),
+      m_status(ThreadStatus::SEARCHING),
       m_nodes_searched(0),
-      m_multiPV(UCI::Options::MultiPV)
+      m_multiPV(UCI::Options::MultiPV),
+      m_completed_depth(0),
+      m_group(0),
+      m_resume(false),
+      m_regroup(false)
 {
+    // Block until the thread is parked, otherwise an early signal could be overwritten by the loop
     m_thread = std::thread(&Thread::thread_loop, this);
+    wait();
 }
 
 
@@ -39,7 +52,24 @@ void Thread::thread_loop()
         lock.unlock();
 
         if (m_status == ThreadStatus::SEARCHING)
+        {
+            bool counters = UCI::Options::PerfCounters && m_counters.start();
             search();
+
+            // Helpers pondering a reply that was not played rejoin the main root after a ponderhit
+            while (m_regroup.exchange(false))
+            {
+                m_group = 0;
+                m_resume = false;
+                m_position = m_pool.m_position;
+                search();
+            }
+
+            if (counters)
+                m_counters.stop();
+        }
+        else if (m_status == ThreadStatus::WORKING)
+            run_tasks();
     }
 }
 
@@ -47,7 +77,7 @@ void Thread::thread_loop()
 void Thread::wait()
 {
     std::unique_lock<std::mutex> lock(m_mutex);
-    m_cvar.wait(lock, [this]{ return m_status != ThreadStatus::SEARCHING; });
+    m_cvar.wait(lock, [this]{ return m_status != ThreadStatus::SEARCHING && m_status != ThreadStatus::WORKING; });
 }
 
 
@@ -59,6 +89,35 @@ void Thread::wake(ThreadStatus status)
 }
 
 
+void Thread::wake_idle(ThreadStatus status)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_status != ThreadStatus::WAITING)
+        return;
+    m_status = status;
+    m_cvar.notify_one();
+}
+
+
+void Thread::run_tasks()
+{
+    // Own tasks first, newest first, then stolen ones: workers leave once every task has finished
+    t_worker = this;
+    while (m_pool.m_pending_tasks.load(std::memory_order_acquire) > 0)
+    {
+        Tasks::Task* task = m_tasks.pop();
+        if (!task)
+            task = m_pool.find_task(m_id + 1);
+
+        if (task)
+            m_pool.execute(task);
+        else
+            std::this_thread::yield();
+    }
+    t_worker = nullptr;
+}
+
+
 void Thread::update_position(const Position& position) { m_position = position; }
 
 
@@ -71,30 +130,83 @@ bool Thread::is_root_move(Move move) const
 void Thread::output_pvs()
 {
     double elapsed = m_pool.m_time.elapsed();
-    uint64_t nodes = m_pool.nodes_searched();
+    uint64_t nodes = m_pool.nodes_searched() + Cluster::remote_nodes();
+    int hashfull = m_pool.m_tt.hashfull();
 
     // Output information
     for (int iPV = 0; iPV < UCI::Options::MultiPV; iPV++)
-        m_multiPV[iPV].write_pv(iPV, nodes, elapsed);
+        if (!m_pool.m_listeners.info)
+            m_multiPV[iPV].write_pv(iPV, nodes, elapsed, hashfull);
+        else if (m_multiPV[iPV].type != Search::BoundType::NO_BOUND)
+            m_pool.m_listeners.info(iPV, m_multiPV[iPV], nodes, elapsed, hashfull);
 }
 
 
 int Thread::id() const { return m_id; }
+int Thread::group() const { return m_group; }
+TreeLog::Writer& Thread::tree_log() { return m_tree_log; }
+Search::SearchStats& Thread::stats() { return m_stats; }
 bool Thread::is_main() const { return m_id == 0; }
 ThreadPool& Thread::pool() const { return m_pool; }
 const Search::SearchTime& Thread::time() const { return m_pool.m_time; }
 const Search::Limits& Thread::limits() const { return m_pool.m_limits; }
+HashTable<TranspositionEntry>& Thread::qsearch_table() { return m_qtable; }
+
+
+bool Thread::resize_qtable()
+{
+    std::size_t size_mb = UCI::Options::QSearchHash ? m_pool.m_qtable_mb : 0;
+    if (m_qtable.size_mb() == size_mb)
+        return false;
+
+    m_qtable.resize(size_mb);
+    return true;
+}
+
+
+std::size_t Thread::memory() const
+{
+    return sizeof(Thread) + m_position.memory() + m_qtable.memory()
+         + m_multiPV.capacity() * sizeof(Search::MultiPVData);
+}
 
 
 
 ThreadPool::ThreadPool()
     : m_threads(0),
-      m_status(ThreadStatus::WAITING)
+      m_tt(UCI::Options::Hash),
+      m_qtable_mb(1),
+      m_tree_mb(UCI::Options::Hash),
+      m_last_multiPV(0),
+      m_resumable(false),
+      m_available_nodes(0),
+      m_ponderhit_nodes(0),
+      m_tree_depth(NUM_MAX_DEPTH),
+      m_tree_ply(NUM_MAX_PLY),
+      m_root_score(0),
+      m_status(ThreadStatus::WAITING),
+      m_helpers_parked(false),
+      m_park_at_start(false),
+      m_forced_move(false),
+      m_stable_move(MOVE_NULL),
+      m_stable_score(0),
+      m_stable_iterations(0),
+      m_split(false),
+      m_split_next(0),
+      m_split_depth(0),
+      m_split_closed(false),
+      m_pending_tasks(0)
 {
     m_threads.push_back(std::make_unique<Thread>(0, *this));
 }
 
 
+ThreadPool::~ThreadPool()
+{
+    kill_threads();
+}
+
+
 void ThreadPool::send_signal(ThreadStatus signal)
 {
     for (auto& thread : m_threads)
@@ -113,17 +225,34 @@ void ThreadPool::kill_threads()
 }
 
 
+void ThreadPool::clear()
+{
+    // A new game or an explicit clear: also forget the state of the previous search
+    m_tt.clear();
+    m_resumable = false;
+    m_available_nodes = 0;
+}
+
+
 void ThreadPool::resize(int n_threads)
 {
     kill_threads();
     m_threads.clear();
+    m_resumable = false;
     for (int i = 0; i < n_threads; i++)
         m_threads.push_back(std::make_unique<Thread>(i, *this));
+
+    // New threads start from the current position
+    update_position_threads();
 }
 
 
 void ThreadPool::update_position_threads()
 {
+    // The bestmove is sent before the helpers have unwound their search, so a new position may
+    // arrive while they still use theirs
+    wait();
+
     // Update position in search threads
     for (auto& thread : m_threads)
         thread->update_position(m_position);
@@ -132,16 +261,104 @@ void ThreadPool::update_position_threads()
 
 void ThreadPool::search(const Search::Timer& timer, const Search::Limits& limits, bool wait)
 {
-    // Ensure all threads are stopped before we start searching
+    // Ensure all threads are stopped before we start searching. From then on, tasks run inline on
+    // their callers and the workers still running earlier tasks are waited for.
+    this->wait();
+    {
+        std::lock_guard<std::mutex> lock(m_task_mutex);
+        m_status = ThreadStatus::SEARCHING;
+    }
     this->wait();
 
+    // Analysis continuation: with the same root position, MultiPV and searchmoves as the previous
+    // alpha-beta search, the threads resume from their last completed iteration. After a multi-ponder
+    // miss, this continues the group that searched the reply actually played. Searches writing a
+    // tree log or partitioning the root moves start afresh, since the log would otherwise miss the
+    // resumed iterations and the split jobs start from the first depth.
+    bool alpha_beta = UCI::Options::SearchMode == "AlphaBeta";
+    bool splitting = UCI::Options::RootSplit && UCI::Options::MultiPV > 1;
+    bool compatible = alpha_beta && m_resumable && m_tree_path.empty() && !splitting &&
+                      m_last_multiPV == UCI::Options::MultiPV &&
+                      m_limits.searchmoves == limits.searchmoves;
+    int matching_group = -1;
+    for (int group = 0; compatible && group < (int)m_roots.size() && matching_group < 0; group++)
+        if (m_position.same_state(m_roots[group]))
+            matching_group = group;
+
+    Thread* leader = nullptr;
+    for (auto& thread : m_threads)
+    {
+        thread->m_resume = matching_group >= 0 && thread->m_group == matching_group;
+        if (thread->m_resume && !leader)
+            leader = thread.get();
+    }
+
+    // The main thread takes over the state of the matching group
+    Thread& main = *m_threads.front();
+    if (leader && leader != &main)
+    {
+        main.m_histories = leader->m_histories;
+        main.m_completed_depth = leader->m_completed_depth;
+        main.m_completed_pvs = leader->m_completed_pvs;
+        main.m_resume = true;
+    }
+
+    m_resumable = alpha_beta;
+    m_last_multiPV = UCI::Options::MultiPV;
+    assign_roots(alpha_beta && limits.ponder);
+
     // Set the search data before waking the threads
-    m_status = ThreadStatus::SEARCHING;
     m_limits = limits;
+    m_root_score.store(0);
+    m_ponderhit_nodes.store(0);
 
     // Estimate search time
     update_time(timer, limits);
 
+    // Root move partitioning replaces the MultiPV loop of each thread by (depth, root move) jobs
+    // shared by all threads, so that each root move is searched once per depth
+    m_split = alpha_beta && UCI::Options::RootSplit && UCI::Options::MultiPV > 1 && m_roots.size() == 1;
+    if (m_split)
+    {
+        m_split_moves.clear();
+        for (Move move : m_position.generate_moves(MoveGenType::LEGAL))
+            if (limits.searchmoves.empty() ||
+                std::find(limits.searchmoves.begin(), limits.searchmoves.end(), move) != limits.searchmoves.end())
+                m_split_moves.push_back(move);
+        m_split_next = 0;
+        m_split_results.clear();
+        m_split_done.clear();
+        m_split_depth = 0;
+        m_split_pvs.clear();
+        m_split_closed = false;
+        m_resumable = false;
+    }
+
+    // Helpers stay parked until the main thread reaches HelperDepth or HelperTime has elapsed, and
+    // for the whole search with a single root move
+    Depth start_depth = main.m_resume ? main.m_completed_depth : 0;
+    m_forced_move = limits.searchmoves.size() == 1 || m_position.generate_moves(MoveGenType::LEGAL).length() == 1;
+    m_park_at_start = start_depth < UCI::Options::HelperDepth;
+    m_park_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(UCI::Options::HelperTime);
+    m_helpers_parked = alpha_beta && !m_split && size() > 1 && (m_park_at_start || m_forced_move);
+    m_stable_move = MOVE_NULL;
+    m_stable_iterations = 0;
+
+    // MCTS searches start from an empty shared tree
+    if (UCI::Options::SearchMode == "MCTS")
+        m_tree.clear(size(), m_tree_mb);
+
+    // Tree dump of a single search
+    if (!m_tree_path.empty())
+    {
+        if (m_tree_file.open(m_tree_path))
+            for (auto& thread : m_threads)
+                thread->m_tree_log.start(&m_tree_file, thread->m_id, m_tree_depth, m_tree_ply);
+        else if (!has_listeners())
+            std::cout << "info string cannot open " << m_tree_path << std::endl;
+        m_tree_path.clear();
+    }
+
     // Wake threads
     send_signal(ThreadStatus::SEARCHING);
 
@@ -153,6 +370,10 @@ void ThreadPool::search(const Search::Timer& timer, const Search::Limits& limits
 void ThreadPool::stop()
 {
     m_status = ThreadStatus::WAITING;
+
+    // Release the parked helpers, under the lock so that none misses the change
+    std::lock_guard<std::mutex> lock(m_park_mutex);
+    m_park_cvar.notify_all();
 }
 
 
@@ -163,9 +384,238 @@ void ThreadPool::wait()
 }
 
 
+void ThreadPool::submit(std::function<void()> task, Tasks::WaitGroup& group)
+{
+    group.add();
+
+    // Tasks spawned by a task go to the deque of its worker, or run at once if it is full
+    if (t_worker && &t_worker->m_pool == this)
+    {
+        Tasks::Task* item = new Tasks::Task{ std::move(task), &group };
+        m_pending_tasks++;
+        if (!t_worker->m_tasks.push(item))
+            execute(item);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_task_mutex);
+
+    // Never disturb a running search: its threads are busy, so the caller does the work
+    if (m_status == ThreadStatus::SEARCHING)
+    {
+        lock.unlock();
+        task();
+        group.done();
+        return;
+    }
+
+    m_injected_tasks.push_back(new Tasks::Task{ std::move(task), &group });
+    m_pending_tasks++;
+    if (m_status != ThreadStatus::WORKING)
+    {
+        m_status = ThreadStatus::WORKING;
+        for (auto& thread : m_threads)
+            thread->wake_idle(ThreadStatus::WORKING);
+    }
+}
+
+
+void ThreadPool::wait_group(Tasks::WaitGroup& group)
+{
+    // The caller runs tasks while waiting, which also ensures progress when no worker is idle
+    Thread* worker = t_worker && &t_worker->m_pool == this ? t_worker : nullptr;
+    while (!group.finished())
+    {
+        Tasks::Task* task = worker ? worker->m_tasks.pop() : nullptr;
+        if (!task)
+            task = find_task(worker ? worker->m_id + 1 : 0);
+
+        if (task)
+            execute(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+
+bool ThreadPool::parallel_for(int begin, int end, const std::function<void(int)>& body)
+{
+    // One task per thread, each taking the next index until none is left: iterations of uneven
+    // cost are balanced without flooding the queues
+    std::atomic_int next(begin);
+    std::atomic_bool interrupted(false);
+    Tasks::WaitGroup group;
+    int n_tasks = std::min(end - begin, size());
+    for (int i = 0; i < n_tasks; i++)
+        submit([&]()
+        {
+            for (int index = next++; index < end; index = next++)
+            {
+                if (cancelled())
+                {
+                    interrupted = true;
+                    return;
+                }
+                body(index);
+            }
+        }, group);
+    wait_group(group);
+    return !interrupted;
+}
+
+
+bool ThreadPool::cancelled() const
+{
+    return m_status.load(std::memory_order_relaxed) == ThreadStatus::WAITING;
+}
+
+
+Tasks::Task* ThreadPool::find_task(int first)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_task_mutex);
+        if (!m_injected_tasks.empty())
+        {
+            Tasks::Task* task = m_injected_tasks.front();
+            m_injected_tasks.pop_front();
+            return task;
+        }
+    }
+
+    for (int i = 0; i < size(); i++)
+        if (Tasks::Task* task = m_threads[(first + i) % size()]->m_tasks.steal())
+            return task;
+    return nullptr;
+}
+
+
+void ThreadPool::execute(Tasks::Task* task)
+{
+    task->function();
+    task->group->done();
+    delete task;
+
+    // The last task ends the working phase, unless stop() or a search already did
+    if (--m_pending_tasks == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_task_mutex);
+        ThreadStatus working = ThreadStatus::WORKING;
+        if (m_pending_tasks == 0)
+            m_status.compare_exchange_strong(working, ThreadStatus::WAITING);
+    }
+}
+
+
 void ThreadPool::ponderhit()
 {
+    // The nodes searched while pondering are not charged to the engine clock
+    m_ponderhit_nodes.store(nodes_searched());
     m_time.ponderhit();
+
+    // The expected reply was played: threads pondering other replies join the main search
+    for (auto& thread : m_threads)
+        if (thread->m_group != 0)
+            thread->m_regroup = true;
+}
+
+
+void ThreadPool::assign_roots(bool ponder)
+{
+    m_roots.assign(1, m_position);
+    update_position_threads();
+    for (auto& thread : m_threads)
+    {
+        thread->m_group = 0;
+        thread->m_regroup = false;
+    }
+
+    // Multi-ponder needs the expected reply (the last move of the ponder position) and spare threads
+    int n_groups = std::min(UCI::Options::MultiPonder, size());
+    Move expected = m_position.last_move();
+    if (!ponder || n_groups <= 1 || expected == MOVE_NULL)
+        return;
+
+    // Rank the other replies by the scores of the previous search, from the point of view of the
+    // opponent. Replies without a TT entry fall back to their static evaluation, after those with one.
+    Position parent = m_position;
+    parent.unmake_move();
+    parent.set_init_ply();
+    Move moves[NUM_MAX_MOVES];
+    MoveList list(moves);
+    parent.board().generate_moves(list, MoveGenType::LEGAL);
+
+    struct Candidate
+    {
+        Move move;
+        bool tt_hit;
+        int score;
+    };
+    std::vector<Candidate> candidates;
+    for (Move move : list)
+    {
+        parent.make_move(move);
+        TranspositionEntry* entry = nullptr;
+        bool tt_hit = m_tt.query(parent.hash(), &entry) && entry->type() != EntryType::EMPTY;
+        int score = tt_hit ? -score_from_tt(entry->score(), 1)
+                           : -turn_to_color(parent.get_turn()) * evaluate<false>(parent);
+        parent.unmake_move();
+
+        // The expected reply always gets its own group
+        candidates.push_back(Candidate{ move, tt_hit || move == expected, score });
+    }
+    std::sort(candidates.begin(), candidates.end(), [expected](const Candidate& a, const Candidate& b)
+    {
+        if ((a.move == expected) != (b.move == expected))
+            return a.move == expected;
+        return a.tt_hit != b.tt_hit ? a.tt_hit : a.score > b.score;
+    });
+    n_groups = std::min(n_groups, (int)candidates.size());
+    if (n_groups <= 1)
+        return;
+
+    // Threads are shared in proportion to exp(score difference / 100cp), each group getting at least one
+    std::vector<double> weights(n_groups);
+    std::vector<int> counts(n_groups, 1);
+    int best_score = candidates[0].score;
+    for (int group = 0; group < n_groups; group++)
+        best_score = std::max(best_score, candidates[group].score);
+    for (int group = 0; group < n_groups; group++)
+        weights[group] = std::exp((candidates[group].score - best_score) / 100.0);
+    for (int spare = size() - n_groups; spare > 0; spare--)
+    {
+        int best = 0;
+        for (int group = 1; group < n_groups; group++)
+            if (weights[group] / counts[group] > weights[best] / counts[best])
+                best = group;
+        counts[best]++;
+    }
+
+    // The main thread stays in the group of the expected reply
+    for (int group = 1; group < n_groups; group++)
+    {
+        Position root = parent;
+        root.make_move(candidates[group].move);
+        root.set_init_ply();
+        m_roots.push_back(root);
+    }
+
+    int thread_index = 0;
+    for (int group = 0; group < n_groups; group++)
+        for (int i = 0; i < counts[group]; i++, thread_index++)
+        {
+            Thread& thread = *m_threads[thread_index];
+            thread.m_group = group;
+            thread.m_resume = thread.m_resume && group == 0;
+            thread.update_position(m_roots[group]);
+        }
+
+    if (!has_listeners())
+    {
+        std::cout << "info string multiponder";
+        for (int group = 0; group < n_groups; group++)
+            std::cout << " " << candidates[group].move << " " << counts[group];
+        std::cout << std::endl;
+    }
 }
 
 
@@ -179,16 +629,28 @@ void ThreadPool::update_time(const Search::Timer& timer, const Search::Limits& l
 {
     Turn turn = m_position.get_turn();
 
+    // Node-based time: the clock is converted to nodes on the first move and then tracked by the
+    // engine itself, so that the time management does not depend on the machine load
+    int nodes_time = UCI::Options::NodesTime;
+    int time_left = limits.time[turn];
+    m_time.set_nodes_time(nodes_time, [this]() { return nodes_searched(); });
+    if (nodes_time > 0 && time_left >= 0)
+    {
+        if (m_available_nodes == 0)
+            m_available_nodes = static_cast<int64_t>(time_left) * nodes_time;
+        time_left = m_available_nodes / nodes_time;
+    }
+
     // Fixed movetime
     if (limits.movetime >= 0)
         m_time.init(timer, limits.movetime, limits.ponder);
 
     // With clock time
-    else if (limits.time[turn] >= 0)
+    else if (time_left >= 0)
     {
         // Number of expected remaining moves
         int n_expected_moves = limits.movestogo >= 0 ? std::min(50, limits.movestogo) : 50;
-        int time_remaining = limits.time[turn] + limits.incr[turn] * (n_expected_moves - 1);
+        int time_remaining = time_left + limits.incr[turn] * (n_expected_moves - 1);
 
         // This move will use 1/n_expected_moves of the remaining time
         int movetime = time_remaining / n_expected_moves;
@@ -201,6 +663,46 @@ void ThreadPool::update_time(const Search::Timer& timer, const Search::Limits& l
 }
 
 
+void ThreadPool::log_next_search(const std::string& path, Depth max_depth, int max_ply)
+{
+    m_tree_path = path;
+    m_tree_depth = max_depth;
+    m_tree_ply = max_ply;
+}
+
+
+void ThreadPool::finish_tree_log()
+{
+    // Called from the main thread: the helpers must be done writing before their buffers are flushed
+    for (auto& thread : m_threads)
+    {
+        if (!thread->is_main())
+            thread->wait();
+        thread->m_tree_log.stop();
+    }
+
+    uint64_t n_records = m_tree_file.close();
+    if (!has_listeners())
+        std::cout << "info string tree log " << n_records << " records" << std::endl;
+}
+
+
+void ThreadPool::report_counters()
+{
+    // Called from the main thread: wait for the helpers to finish before collecting their counters
+    Perf::Sample sample;
+    for (auto& thread : m_threads)
+    {
+        if (!thread->is_main())
+            thread->wait();
+        sample += thread->m_counters.read();
+    }
+
+    if (!has_listeners())
+        std::cout << "info string " << Perf::report(sample, nodes_searched(), m_time.elapsed()) << std::endl;
+}
+
+
 const std::atomic<ThreadStatus>& ThreadPool::status() const { return m_status; }
 
 
@@ -208,6 +710,209 @@ Position& ThreadPool::position() { return m_position; }
 Position ThreadPool::position() const { return m_position; }
 
 
+HashTable<TranspositionEntry>& ThreadPool::tt() { return m_tt; }
+
+
+void ThreadPool::set_memory(std::size_t tt_mb, std::size_t qtable_mb, std::size_t tree_mb)
+{
+    // Only reallocate (and clear) the transposition table if its size changes
+    if (m_tt.size_mb() != tt_mb)
+        m_tt.resize(tt_mb);
+
+    // Quiescence tables are allocated up front, the MCTS tree grows during searches up to its size
+    m_qtable_mb = qtable_mb;
+    m_tree_mb = tree_mb;
+    for (auto& thread : m_threads)
+        thread->resize_qtable();
+}
+
+
+std::size_t ThreadPool::thread_memory() const
+{
+    // Worst case for the search state of one thread, excluding its quiescence table: the current
+    // game history plus a full-depth search on top of it
+    const Thread& main = *m_threads.front();
+    return sizeof(Thread)
+         + main.m_position.memory() + NUM_MAX_PLY * Position::memory_per_ply()
+         + UCI::Options::MultiPV * sizeof(Search::MultiPVData);
+}
+
+
+std::size_t ThreadPool::qtable_mb() const { return m_qtable_mb; }
+std::size_t ThreadPool::tree_mb() const { return m_tree_mb; }
+
+
+std::size_t ThreadPool::memory() const
+{
+    std::size_t total = sizeof(ThreadPool) + m_tt.memory() + m_tree.memory();
+    for (auto& thread : m_threads)
+        total += thread->memory();
+    return total;
+}
+
+
+void ThreadPool::set_listeners(const SearchListeners& listeners) { m_listeners = listeners; }
+
+
+void ThreadPool::publish_root_score(Depth depth, Score score)
+{
+    // Packed as depth (high half) and score (low half), only deeper results replace the current one
+    uint32_t packed = (uint32_t(depth) << 16) | uint16_t(score);
+    uint32_t current = m_root_score.load(std::memory_order_relaxed);
+    while ((current >> 16) < depth &&
+           !m_root_score.compare_exchange_weak(current, packed, std::memory_order_relaxed))
+    {}
+}
+
+
+bool ThreadPool::shared_root_score(Depth min_depth, Score& score) const
+{
+    uint32_t packed = m_root_score.load(std::memory_order_relaxed);
+    if (packed == 0 || Depth(packed >> 16) < min_depth)
+        return false;
+
+    score = static_cast<Score>(packed & 0xFFFF);
+    return true;
+}
+
+
+bool ThreadPool::wait_helper(const Thread& thread)
+{
+    // Returns whether the search is still running once the helper is released
+    std::unique_lock<std::mutex> lock(m_park_mutex);
+    auto released = [&]() { return !thread.parked() || m_status != ThreadStatus::SEARCHING; };
+    if (m_park_at_start && !m_forced_move && UCI::Options::HelperTime > 0)
+    {
+        // HelperTime elapsed before the main thread reached HelperDepth
+        if (!m_park_cvar.wait_until(lock, m_park_deadline, released))
+        {
+            m_park_at_start = false;
+            m_helpers_parked = false;
+            m_park_cvar.notify_all();
+        }
+    }
+    else
+        m_park_cvar.wait(lock, released);
+    return m_status == ThreadStatus::SEARCHING;
+}
+
+
+void ThreadPool::update_helpers(Depth depth, Move best_move, Score score)
+{
+    if (size() == 1 || m_forced_move || UCI::Options::SearchMode != "AlphaBeta")
+        return;
+
+    // The root is stable after HelperStable iterations with the same best move and a close score
+    constexpr Score STABLE_MARGIN = 15;
+    bool stable = best_move == m_stable_move && std::abs(score - m_stable_score) <= STABLE_MARGIN;
+    m_stable_iterations = stable ? m_stable_iterations + 1 : 0;
+    m_stable_move = best_move;
+    m_stable_score = score;
+
+    std::lock_guard<std::mutex> lock(m_park_mutex);
+    if (depth >= UCI::Options::HelperDepth)
+        m_park_at_start = false;
+
+    // Analysis keeps every thread busy once started
+    bool parked = m_park_at_start ||
+                  (UCI::Options::HelperStable > 0 && !m_limits.infinite &&
+                   m_stable_iterations >= UCI::Options::HelperStable);
+    if (parked != m_helpers_parked)
+    {
+        m_helpers_parked = parked;
+        m_park_cvar.notify_all();
+    }
+}
+
+
+bool ThreadPool::next_split_job(Depth& depth, int& index, Search::MultiPVData& pv)
+{
+    // Jobs are handed out depth by depth, in the order of the root moves
+    int n_moves = m_split_moves.size();
+    int job = m_split_next.fetch_add(1);
+    int job_depth = job / n_moves + 1;
+    if (job_depth >= NUM_MAX_DEPTH || (job_depth > m_limits.depth && !pondering()))
+        return false;
+
+    depth = job_depth;
+    index = job % n_moves;
+
+    // The Pv line of the previous depth, when already known, orders the moves of this one
+    std::lock_guard<std::mutex> lock(m_split_mutex);
+    if ((int)m_split_results.size() < depth)
+    {
+        m_split_results.resize(depth, std::vector<Search::MultiPVData>(n_moves));
+        m_split_done.resize(depth, 0);
+    }
+    pv = depth > 1 ? m_split_results[depth - 2][index] : Search::MultiPVData();
+    return true;
+}
+
+
+void ThreadPool::store_split_result(int index, const Search::MultiPVData& pv)
+{
+    std::lock_guard<std::mutex> lock(m_split_mutex);
+    if (m_split_closed)
+        return;
+
+    m_split_results[pv.depth - 1][index] = pv;
+    m_split_done[pv.depth - 1]++;
+
+    // Report each depth once all of its root moves are searched, sorted by score
+    int n_moves = m_split_moves.size();
+    while (m_split_depth < (int)m_split_done.size() && m_split_done[m_split_depth] == n_moves)
+    {
+        m_split_pvs = m_split_results[m_split_depth++];
+        std::stable_sort(m_split_pvs.begin(), m_split_pvs.end(),
+                         [](const Search::MultiPVData& a, const Search::MultiPVData& b) { return a.score > b.score; });
+        m_split_pvs.resize(std::min(n_moves, UCI::Options::MultiPV));
+
+        double elapsed = m_time.elapsed();
+        uint64_t nodes = nodes_searched() + Cluster::remote_nodes();
+        int hashfull = m_tt.hashfull();
+        for (int iPV = 0; iPV < (int)m_split_pvs.size(); iPV++)
+            if (!m_listeners.info)
+                m_split_pvs[iPV].write_pv(iPV, nodes, elapsed, hashfull);
+            else
+                m_listeners.info(iPV, m_split_pvs[iPV], nodes, elapsed, hashfull);
+    }
+    m_split_cvar.notify_all();
+}
+
+
+void ThreadPool::wait_split(const Thread& thread)
+{
+    // The main thread, out of jobs, waits for the other threads to complete the last depth
+    int last_depth = std::min(m_limits.depth, NUM_MAX_DEPTH - 1);
+    std::unique_lock<std::mutex> lock(m_split_mutex);
+    while (m_split_depth < last_depth && !thread.timeout())
+        m_split_cvar.wait_for(lock, std::chrono::milliseconds(1));
+}
+
+
+void ThreadPool::close_split(std::vector<Search::MultiPVData>& pvs)
+{
+    // Results stored from now on would come after the bestmove
+    std::lock_guard<std::mutex> lock(m_split_mutex);
+    m_split_closed = true;
+    for (auto& line : pvs)
+    {
+        line = Search::MultiPVData();
+        line.pv[0] = MOVE_NULL;
+        line.pv[1] = MOVE_NULL;
+    }
+    std::copy(m_split_pvs.begin(), m_split_pvs.end(), pvs.begin());
+
+    // Stopped before the first depth was complete: any root move will do
+    if (m_split_pvs.empty())
+        pvs.front().pv[0] = m_split_moves.front();
+}
+
+
+bool ThreadPool::root_split() const { return m_split; }
+bool ThreadPool::has_listeners() const { return m_listeners.info || m_listeners.bestmove; }
+
+
 int64_t ThreadPool::nodes_searched() const
 {
     int64_t total = 0;
@@ -217,13 +922,23 @@ int64_t ThreadPool::nodes_searched() const
 }
 
 
+Search::SearchStats ThreadPool::stats() const
+{
+    Search::SearchStats total;
+    for (auto& thread : m_threads)
+        total += thread->m_stats;
+    return total;
+}
+
+
 int ThreadPool::size() const { return m_threads.size(); }
 
 
 bool Thread::timeout() const
 {
-    // Aborted search
-    if (m_pool.status().load(std::memory_order_relaxed) != ThreadStatus::SEARCHING)
+    // Aborted search (or a pondered reply that was not played)
+    if (m_pool.status().load(std::memory_order_relaxed) != ThreadStatus::SEARCHING ||
+        m_regroup.load(std::memory_order_relaxed))
         return true;
 
     // Never timeout in ponder mode
@@ -234,22 +949,29 @@ bool Thread::timeout() const
     if (time().remaining() <= 0)
         return true;
 
-    // Approximate number of nodes
-    if (m_nodes_searched.load(std::memory_order_relaxed) > m_pool.m_limits.nodes / m_pool.size())
+    // Helpers parked by the main thread
+    if (parked())
+        return true;
+
+    // Number of nodes: the threads may not have searched evenly (helpers join late or are parked),
+    // so the total is summed once this thread is past its share
+    if (m_nodes_searched.load(std::memory_order_relaxed) > m_pool.m_limits.nodes / m_pool.size() &&
+        static_cast<uint64_t>(m_pool.nodes_searched()) > m_pool.m_limits.nodes)
         return true;
 
     return false;
 }
 
 
-void Thread::search()
+bool Thread::parked() const
 {
-    bool main_thread = is_main();
-    const Search::Limits& limits = m_pool.m_limits;
-    const Search::SearchTime& time = m_pool.m_time;
+    return !is_main() && m_group == 0 && m_pool.m_helpers_parked.load(std::memory_order_relaxed);
+}
 
-    // Generate root moves
-    Move moves[NUM_MAX_MOVES];
+
+void Thread::generate_root_moves(Move* moves)
+{
+    const Search::Limits& limits = m_pool.m_limits;
     m_root_moves = MoveList(moves);
     m_position.board().generate_moves(m_root_moves, MoveGenType::LEGAL);
 
@@ -263,6 +985,17 @@ void Thread::search()
             else
                 m++;
     }
+}
+
+
+void Thread::search()
+{
+    bool main_thread = is_main();
+    const Search::Limits& limits = m_pool.m_limits;
+
+    // Generate root moves
+    Move moves[NUM_MAX_MOVES];
+    generate_root_moves(moves);
 
     // Check for aborted search if game has ended
     if (m_root_moves.length() == 0 || m_position.is_draw(false))
@@ -270,8 +1003,13 @@ void Thread::search()
         if (main_thread)
         {
             // Even in this case, output a score and bestmove
-            std::cout << "info depth 0 score " << (m_position.in_check() ? "mate 0" : "cp 0") << std::endl;
-            std::cout << "bestmove " << MOVE_NULL << std::endl;
+            if (m_pool.m_listeners.bestmove)
+                m_pool.m_listeners.bestmove(MOVE_NULL, MOVE_NULL);
+            else
+            {
+                std::cout << "info depth 0 score " << (m_position.in_check() ? "mate 0" : "cp 0") << std::endl;
+                std::cout << "bestmove " << MOVE_NULL << std::endl;
+            }
             
             // Stop the search
             m_pool.stop();
@@ -282,24 +1020,179 @@ void Thread::search()
     // Maximum PV lines
     int maxPv = std::min(m_root_moves.length(), UCI::Options::MultiPV);
 
-    // Prepare multiPV data
+    // Prepare multiPV data and clear the search state, unless we continue the previous search
+    m_nodes_searched.store(0);
+    m_stats = Search::SearchStats();
+    if (m_resume)
+        resume(maxPv);
+    else
+    {
+        m_multiPV.resize(UCI::Options::MultiPV);
+        std::fill(m_multiPV.begin(), m_multiPV.end(), Search::MultiPVData());
+        m_histories.clear();
+        m_completed_depth = 0;
+        m_completed_pvs.clear();
+    }
+
+    // A fresh quiescence table for each search (or a minimal one if not in use)
+    if (!resize_qtable() && !m_resume)
+        m_qtable.clear();
+
+    if (UCI::Options::SearchMode == "MCTS")
+        m_pool.m_tree.search(m_position, *this, maxPv);
+    else if (m_pool.m_split)
+        split_search(moves);
+    else if (main_thread)
+        iterative_deepening(maxPv);
+    else
+    {
+        // Helpers wait while parked. Those parked in the middle of the search continue from their
+        // last completed iteration once released.
+        bool started = false;
+        while (m_pool.wait_helper(*this))
+        {
+            if (started)
+            {
+                generate_root_moves(moves);
+                resume(maxPv);
+            }
+            started = true;
+            iterative_deepening(maxPv);
+            if (!parked())
+                break;
+        }
+    }
+
+    // Main thread is responsible for the bestmove output
+    if (main_thread)
+    {
+        // While pondering or in infinite mode we should not send a premature bestmove, so
+        // we park here until the search gets stopped or we get a ponderhit
+        while (!timeout() && (m_pool.pondering() || limits.infinite)) {}
+
+        // Stop the search
+        m_pool.stop();
+
+        // Take over the report of the last depth completed by all threads
+        if (m_pool.m_split)
+            m_pool.close_split(m_multiPV);
+
+        // Complete the tree dump before the bestmove, so that it can be read right away
+        if (m_pool.m_tree_file.is_open())
+            m_pool.finish_tree_log();
+
+        // Node-based time: charge this move to the engine clock, net of the increment. A ponder search
+        // is only charged for the nodes after the ponderhit, and not at all if stopped before it
+        Turn turn = m_position.get_turn();
+        if (UCI::Options::NodesTime > 0 && limits.time[turn] >= 0 && !m_pool.m_time.pondering())
+            m_pool.m_available_nodes = std::max<int64_t>(1, m_pool.m_available_nodes - m_pool.nodes_searched() +
+                                                            m_pool.m_ponderhit_nodes.load() +
+                                                            static_cast<int64_t>(limits.incr[turn]) * UCI::Options::NodesTime);
+
+        // Hardware counters of the whole search
+        if (UCI::Options::PerfCounters)
+        {
+            m_counters.stop();
+            m_pool.report_counters();
+        }
+
+        // Fetch best and ponder moves from best Pv line
+        Move* best_pv = m_multiPV.front().pv;
+        Move bestmove = *best_pv;
+        Move pondermove = *(best_pv + 1);
+
+        // A cluster worker may have searched deeper
+        if (Cluster::active())
+        {
+            Cluster::Result best{ bestmove, pondermove, m_multiPV.front().score, m_multiPV.front().depth };
+            int worker = Cluster::finish_search(m_position, best);
+            if (worker >= 0 && !m_pool.m_listeners.bestmove)
+                std::cout << "info string cluster bestmove from worker " << worker << std::endl;
+            bestmove = best.bestmove;
+            pondermove = best.ponder;
+        }
+
+        // Mandatory output to the GUI
+        if (m_pool.m_listeners.bestmove)
+            m_pool.m_listeners.bestmove(bestmove, pondermove);
+        else
+        {
+            std::cout << "bestmove " << bestmove;
+            if (pondermove != MOVE_NULL)
+                std::cout << " ponder " << pondermove;
+            std::cout << std::endl;
+        }
+    }
+}
+
+
+void Thread::resume(int n_pvs)
+{
+    // Results of an interrupted iteration may be partial, go back to the last completed one
+    m_multiPV = m_completed_pvs;
     m_multiPV.resize(UCI::Options::MultiPV);
-    std::fill(m_multiPV.begin(), m_multiPV.end(), Search::MultiPVData());
 
-    // Clear data
-    m_histories.clear();
-    m_nodes_searched.store(0);
+    // The iterative deepening loop expects the Pv moves out of the root moves list
+    for (int iPv = 0; iPv < n_pvs; iPv++)
+    {
+        Move* move = std::find(m_root_moves.begin(), m_root_moves.end(), *m_multiPV[iPv].pv);
+        if (move != m_root_moves.end())
+            m_root_moves.pop(move);
+    }
+
+    // Show the previous results right away
+    if (is_main() && m_completed_depth > 0)
+        output_pvs();
+}
+
+
+void Thread::split_search(Move* moves)
+{
+    // Each job searches a single root move with a full window for its exact score
+    Depth depth;
+    int index;
+    Search::MultiPVData pv;
+    while (m_pool.next_split_job(depth, index, pv))
+    {
+        m_root_moves = MoveList(moves);
+        m_root_moves.push(m_pool.m_split_moves[index]);
+        m_tree_log.set_iteration(depth);
+
+        Search::SearchData data(*this);
+        Search::full_window_search(m_position, pv, depth, data);
+        if (timeout())
+            break;
+
+        m_pool.store_split_result(index, pv);
+    }
 
-    // Iterative deepening
-    for (int iDepth = 1;
+    if (is_main())
+        m_pool.wait_split(*this);
+}
+
+
+void Thread::iterative_deepening(int n_pvs)
+{
+    bool main_thread = is_main();
+    const Search::Limits& limits = m_pool.m_limits;
+    const Search::SearchTime& time = m_pool.m_time;
+
+    // Iterative deepening, possibly continuing a previous search
+    for (int iDepth = m_completed_depth + 1;
             iDepth < NUM_MAX_DEPTH && (iDepth <= limits.depth || m_pool.pondering());
             iDepth++)
     {
-        // Start depth timer
-        Search::Timer timer_depth;
+        // Start depth timer, in the units of the time management
+        double depth_start = time.used();
+        m_tree_log.set_iteration(iDepth + m_id / 2);
+
+        // Quiescence statistics are also kept for each iteration
+        Search::SearchStats iteration_stats = m_stats;
+        uint64_t iteration_nodes = m_nodes_searched;
+        m_stats.qsearch_max_ply = 0;
 
         // MultiPV loop
-        for (int iPv = 0; iPv < maxPv; iPv++)
+        for (int iPv = 0; iPv < n_pvs; iPv++)
         {
             Search::SearchData data(*this);
             Search::MultiPVData& pv = m_multiPV[iPv];
@@ -310,7 +1203,10 @@ void Thread::search()
 
             // Carry the aspirated search
             Depth depth = iDepth + m_id / 2;
-            aspiration_search(m_position, pv, depth, data);
+            if (UCI::Options::RootSearch == "MTDf")
+                mtdf_search(m_position, pv, depth, data);
+            else
+                aspiration_search(m_position, pv, depth, data);
 
             // Timeout?
             if (timeout())
@@ -330,14 +1226,37 @@ void Thread::search()
             if (main_thread)
                 output_pvs();
         }
+        Depth qsearch_ply = m_stats.qsearch_max_ply;
+        m_stats.qsearch_max_ply = std::max(qsearch_ply, iteration_stats.qsearch_max_ply);
 
         // Timeout?
         if (timeout())
             break;
 
+        // Keep the results of completed iterations for analysis continuation
+        m_completed_depth = iDepth;
+        m_completed_pvs = m_multiPV;
+
         // Additional task for main thread: check if we need to stop
         if (main_thread)
         {
+            // Release or park the helpers
+            m_pool.update_helpers(iDepth, *m_multiPV.front().pv, m_multiPV.front().score);
+
+            // Quiescence load of this iteration (for the main thread only, as helpers keep updating theirs)
+            if (UCI::Options::QSearchInfo && !m_pool.has_listeners())
+            {
+                uint64_t qsearch_nodes = m_stats.qsearch_nodes - iteration_stats.qsearch_nodes;
+                uint64_t nodes = m_nodes_searched - iteration_nodes;
+                std::cout << "info string qsearch depth " << iDepth
+                          << " nodes " << qsearch_nodes
+                          << " per main node " << static_cast<double>(qsearch_nodes) / std::max<uint64_t>(nodes - qsearch_nodes, 1)
+                          << " max ply " << static_cast<int>(qsearch_ply)
+                          << " ply cutoffs " << m_stats.qsearch_ply_cutoffs - iteration_stats.qsearch_ply_cutoffs
+                          << " limited evasions " << m_stats.qsearch_limited_evasions - iteration_stats.qsearch_limited_evasions
+                          << std::endl;
+            }
+
             // Additional time stopping conditions
             Score score = m_multiPV.front().score;
             if (time.time_management() &&
@@ -347,7 +1266,7 @@ void Thread::search()
                 double remaining = time.remaining();
                 // Best move mate or do we expect not to have time for one more iteration?
                 if (is_mate(score) ||
-                    (remaining > 0 && remaining < timer_depth.elapsed() * 1.5))
+                    (remaining > 0 && remaining < (time.used() - depth_start) * 1.5))
                     break;
             }
 
@@ -358,27 +1277,5 @@ void Thread::search()
                 break;
         }
     }
-
-    // Main thread is responsible for the bestmove output
-    if (main_thread)
-    {
-        // While pondering or in infinite mode we should not send a premature bestmove, so
-        // we park here until the search gets stopped or we get a ponderhit
-        while (!timeout() && (m_pool.pondering() || limits.infinite)) {}
-
-        // Stop the search
-        m_pool.stop();
-
-        // Fetch best and ponder moves from best Pv line
-        Move* best_pv = m_multiPV.front().pv;
-        Move bestmove = *best_pv;
-        Move pondermove = *(best_pv + 1);
-
-        // Mandatory output to the GUI
-        std::cout << "bestmove " << bestmove;
-        if (pondermove != MOVE_NULL)
-            std::cout << " ponder " << pondermove;
-        std::cout << std::endl;
-    }
 }
 
@@ -0,0 +1,175 @@
+#include "../include/treelog.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iomanip>
+#include <map>
+
+
+namespace TreeLog
+{
+    // File header: magic, format version and record size
+    constexpr char MAGIC[8] = { 'H', 'I', 'V', 'E', 'T', 'R', 'E', 'E' };
+    constexpr uint32_t VERSION = 3;
+
+
+
+    File::File()
+        : m_records(0)
+    {}
+
+
+    bool File::open(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_stream)
+            return false;
+
+        uint32_t header[2] = { VERSION, sizeof(Record) };
+        m_stream.write(MAGIC, sizeof(MAGIC));
+        m_stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+        m_records = 0;
+        return true;
+    }
+
+
+    bool File::is_open() const
+    {
+        return m_stream.is_open();
+    }
+
+
+    void File::write(const Record* records, std::size_t count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream.write(reinterpret_cast<const char*>(records), count * sizeof(Record));
+        m_records += count;
+    }
+
+
+    uint64_t File::close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream.close();
+        return m_records;
+    }
+
+
+
+    Writer::Writer()
+        : m_file(nullptr),
+          m_thread(0),
+          m_max_ply(0),
+          m_max_depth(0),
+          m_iteration(0)
+    {}
+
+
+    void Writer::start(File* file, int thread, Depth max_depth, int max_ply)
+    {
+        m_file = file;
+        m_thread = thread;
+        m_max_depth = max_depth;
+        m_max_ply = max_ply;
+        m_iteration = 0;
+        m_buffer.clear();
+        m_buffer.reserve(BUFFER_SIZE);
+    }
+
+
+    void Writer::flush()
+    {
+        if (m_file && !m_buffer.empty())
+            m_file->write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+
+    void Writer::stop()
+    {
+        flush();
+        m_file = nullptr;
+        m_buffer.shrink_to_fit();
+    }
+
+
+
+    bool report(const std::string& path, std::ostream& out)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        uint32_t header[2];
+        if (!stream.read(magic, sizeof(magic)) ||
+            !stream.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+            std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header[0] != VERSION || header[1] != sizeof(Record))
+            return false;
+
+        // Event counts per remaining depth
+        std::map<int, std::array<uint64_t, NUM_EVENTS>> counts;
+        std::array<uint64_t, NUM_EVENTS> totals{};
+        uint64_t n_records = 0;
+        uint64_t tt_hits = 0;
+        int n_threads = 0;
+        int min_iteration = NUM_MAX_DEPTH;
+        int max_iteration = 0;
+
+        Record records[4096];
+        while (stream.read(reinterpret_cast<char*>(records), sizeof(records)) || stream.gcount() > 0)
+        {
+            std::size_t count = stream.gcount() / sizeof(Record);
+            for (std::size_t i = 0; i < count; i++)
+            {
+                const Record& record = records[i];
+                if (record.event >= NUM_EVENTS)
+                    continue;
+
+                auto& row = counts.try_emplace(record.depth).first->second;
+                row[record.event]++;
+                totals[record.event]++;
+                n_records++;
+                tt_hits += record.event <= ETC && (record.flags & TT_HIT);
+                n_threads = std::max(n_threads, record.thread + 1);
+                min_iteration = std::min(min_iteration, static_cast<int>(record.iteration));
+                max_iteration = std::max(max_iteration, static_cast<int>(record.iteration));
+            }
+        }
+
+        const char* names[NUM_EVENTS] = { "searched", "tt-cut", "m-dist", "draw", "futil", "null", "m-cut", "probcut", "etc",
+                                           "see-c", "m-count", "hist", "see-q", "sing", "lmr", "lmr-rs", "pvs-rs" };
+        out << path << ": " << n_records << " records, " << n_threads << " threads, iterations "
+            << (n_records ? min_iteration : 0) << "-" << max_iteration << std::endl;
+
+        // Node exits first, then move decisions
+        out << std::setw(5) << "depth";
+        for (int event = 0; event < NUM_EVENTS; event++)
+            out << std::setw(9) << names[event];
+        out << std::endl;
+        auto write_row = [&](const std::array<uint64_t, NUM_EVENTS>& row)
+        {
+            for (int event = 0; event < NUM_EVENTS; event++)
+                out << std::setw(9) << row[event];
+            out << std::endl;
+        };
+        for (auto& [depth, row] : counts)
+        {
+            out << std::setw(5) << depth;
+            write_row(row);
+        }
+        out << std::setw(5) << "all";
+        write_row(totals);
+
+        // Nodes include every exit, pruned or not
+        uint64_t n_nodes = 0;
+        for (int event = NODE; event <= ETC; event++)
+            n_nodes += totals[event];
+        auto percent = [](uint64_t a, uint64_t b) { return b ? 100.0 * a / b : 0.0; };
+        out << std::fixed << std::setprecision(1)
+            << "nodes " << n_nodes
+            << " tt-hit " << percent(tt_hits, n_nodes) << "%"
+            << " lmr re-searches " << percent(totals[LMR_RESEARCH], totals[LMR] + totals[LMR_RESEARCH]) << "%"
+            << " pvs re-searches " << totals[PVS_RESEARCH] << std::endl;
+        return true;
+    }
+}
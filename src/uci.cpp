@@ -1,14 +1,23 @@
+#include "../include/analysis.hpp"
+#include "../include/cluster.hpp"
+#include "../include/cpu.hpp"
 #include "../include/evaluation.hpp"
 #include "../include/search.hpp"
 #include "../include/tests.hpp"
 #include "../include/hash.hpp"
+#include "../include/perf.hpp"
 #include "../include/types.hpp"
 #include "../include/uci.hpp"
 #include "../include/thread.hpp"
+#include <algorithm>
 #include <array>
+#include <fstream>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 
 
 namespace UCI
@@ -16,17 +25,50 @@ namespace UCI
     std::map<std::string, Option> OptionsMap;
 
 
+    // Last position command, forwarded to the cluster workers
+    std::string last_position;
+
+
     namespace Options
     {
         int Hash;
+        int Memory;
         int MultiPV;
         bool Ponder;
         int Threads;
+        std::string SearchMode;
+        std::string RootSearch;
+        bool QSearchHash;
+        int QSearchPlies;
+        int QSearchChecks;
+        bool QSearchInfo;
+        bool ParallelAspiration;
+        int MultiPonder;
+        int NodesTime;
+        int HelperDepth;
+        int HelperTime;
+        int HelperStable;
+        bool RootSplit;
+        int ClusterDepth;
+        bool ProbCut;
+        bool ETC;
+        bool LMRHistory;
+        bool LMRImproving;
+        bool LMRNodeType;
+        bool PerfCounters;
     }
 
 
     void Option::set(std::string value)
     {
+        // Spin options with an automatic value also accept "auto", resolved again on each refresh
+        if (m_type == OptionType::SPIN && m_automatic)
+        {
+            m_is_auto = (value == "auto");
+            if (m_is_auto)
+                value = std::to_string(m_automatic());
+        }
+
         if (m_type == OptionType::CHECK)
         {
             *std::get<bool*>(m_data) = (value == "true");
@@ -62,6 +104,14 @@ namespace UCI
 
 
 
+    void Option::refresh()
+    {
+        if (m_is_auto)
+            set("auto");
+    }
+
+
+
     std::ostream& operator<<(std::ostream& out, const Option& option)
     {
         std::array<std::string, 5> types{ "check", "spin", "combo", "button", "string" };
@@ -91,15 +141,97 @@ namespace UCI
 
 
 
+    int auto_threads()
+    {
+        CPU::Resources resources = CPU::resources();
+        int threads = CPU::auto_threads(resources);
+        std::cout << "info string Threads auto " << threads << " (" << CPU::describe(resources) << ")" << std::endl;
+        return threads;
+    }
+
+
+
+    int auto_hash()
+    {
+        CPU::Resources resources = CPU::resources();
+        int hash = CPU::auto_hash(resources, HashTable<TranspositionEntry>::max_size());
+        std::cout << "info string Hash auto " << hash << " MB (" << CPU::describe(resources) << ")" << std::endl;
+        return hash;
+    }
+
+
+
     void init_options()
     {
-        OptionsMap.emplace("Clear Hash", Option(OnChange<>([]() { ttable.clear(); })));
-        OptionsMap.emplace("Hash",       Option(&Options::Hash, 16, 1, ttable.max_size(),
-                                                [](int v) { ttable.resize(v); }));
+        OptionsMap.emplace("Clear Hash", Option(OnChange<>([]() { pool->clear(); })));
+        OptionsMap.emplace("Hash",       Option(&Options::Hash, 16, 1, HashTable<TranspositionEntry>::max_size(),
+                                                [](int v) { update_memory(); }, auto_hash));
+        OptionsMap.emplace("Memory",     Option(&Options::Memory, 0, 0, HashTable<TranspositionEntry>::max_size(),
+                                                [](int v) { update_memory(); }));
         OptionsMap.emplace("MultiPV",    Option(&Options::MultiPV, 1, 1, 255));
         OptionsMap.emplace("Threads",    Option(&Options::Threads, 1, 1, 512,
-                                                [](int v) { pool->resize(v); }));
+                                                [](int v) { if (v != pool->size()) pool->resize(v); update_memory(); },
+                                                auto_threads));
         OptionsMap.emplace("Ponder",     Option(&Options::Ponder, false));
+        OptionsMap.emplace("SearchMode", Option(&Options::SearchMode, "AlphaBeta", { "AlphaBeta", "MCTS" },
+                                                [](std::string v) { update_memory(); }));
+        OptionsMap.emplace("RootSearch", Option(&Options::RootSearch, "Aspiration", { "Aspiration", "MTDf" }));
+        OptionsMap.emplace("QSearchHash", Option(&Options::QSearchHash, false,
+                                                 [](bool v) { update_memory(); }));
+        OptionsMap.emplace("QSearchPlies", Option(&Options::QSearchPlies, 32, 0, NUM_MAX_PLY));
+        OptionsMap.emplace("QSearchChecks", Option(&Options::QSearchChecks, 4, 0, NUM_MAX_PLY));
+        OptionsMap.emplace("QSearchInfo", Option(&Options::QSearchInfo, false));
+        OptionsMap.emplace("ParallelAspiration", Option(&Options::ParallelAspiration, false));
+        OptionsMap.emplace("MultiPonder", Option(&Options::MultiPonder, 1, 1, 8));
+        OptionsMap.emplace("NodesTime", Option(&Options::NodesTime, 0, 0, 100000));
+        OptionsMap.emplace("HelperDepth", Option(&Options::HelperDepth, 0, 0, NUM_MAX_DEPTH));
+        OptionsMap.emplace("HelperTime", Option(&Options::HelperTime, 50, 0, 100000));
+        OptionsMap.emplace("HelperStable", Option(&Options::HelperStable, 0, 0, NUM_MAX_DEPTH));
+        OptionsMap.emplace("RootSplit", Option(&Options::RootSplit, false));
+        OptionsMap.emplace("ClusterDepth", Option(&Options::ClusterDepth, 8, 1, NUM_MAX_DEPTH));
+        OptionsMap.emplace("ProbCut", Option(&Options::ProbCut, true));
+        OptionsMap.emplace("ETC", Option(&Options::ETC, true));
+        OptionsMap.emplace("LMRHistory", Option(&Options::LMRHistory, true));
+        OptionsMap.emplace("LMRImproving", Option(&Options::LMRImproving, true));
+        OptionsMap.emplace("LMRNodeType", Option(&Options::LMRNodeType, true));
+        OptionsMap.emplace("PerfCounters", Option(&Options::PerfCounters, false));
+    }
+
+
+
+    void update_memory()
+    {
+        constexpr std::size_t MB = 1024 * 1024;
+
+        // Without a budget, the transposition table and the MCTS tree follow Hash
+        if (Options::Memory == 0)
+        {
+            pool->set_memory(Options::Hash, 1, Options::Hash);
+            return;
+        }
+
+        // Budget split: the search state of each thread is reserved first, then 1/16 of the rest goes to the
+        // per-thread quiescence tables (if enabled, at least 1 MB each), half of what remains to the MCTS tree
+        // (in MCTS mode) and everything else to the transposition table (at least 1 MB)
+        std::size_t n_threads = pool->size();
+        std::size_t state = n_threads * pool->thread_memory();
+        std::size_t rest = std::max(Options::Memory * MB, state) - state;
+
+        std::size_t qtable_mb = Options::QSearchHash ? std::max(rest / 16 / n_threads / MB, std::size_t(1)) : 0;
+        rest -= std::min(rest, n_threads * qtable_mb * MB);
+
+        std::size_t tree_mb = Options::SearchMode == "MCTS" ? rest / 2 / MB : 0;
+        std::size_t tt_mb = std::clamp(rest / MB - tree_mb, std::size_t(1),
+                                       std::size_t(HashTable<TranspositionEntry>::max_size()));
+
+        pool->set_memory(tt_mb, qtable_mb, tree_mb);
+
+        std::cout << "info string memory budget " << Options::Memory << " MB:"
+                  << " hash " << tt_mb << " MB,"
+                  << " qsearch " << n_threads << "x" << qtable_mb << " MB,"
+                  << " mcts " << tree_mb << " MB,"
+                  << " threads " << n_threads << "x" << (pool->thread_memory() + 1023) / 1024 << " kB;"
+                  << " footprint " << (pool->memory() + MB - 1) / MB << " MB" << std::endl;
     }
 
 
@@ -110,7 +242,9 @@ namespace UCI
         while (token != "quit")
         {
             std::string cmd;
-            std::getline(std::cin, cmd);
+            // A closed input (e.g. a cluster worker started in the background) ends the engine
+            if (!std::getline(std::cin, cmd))
+                cmd = "quit";
             Stream stream(cmd);
 
             // Read the first token
@@ -148,6 +282,12 @@ namespace UCI
                 int t3 = Tests::perft_techniques_tests<true, false, false>();
                 int t4 = Tests::perft_techniques_tests<true,  true, false>();
                 int t5 = Tests::perft_techniques_tests<false, false, true>();
+                int t6 = Tests::threat_tests();
+                int t7 = Tests::hash_tests();
+                int t8 = Tests::task_tests();
+                int t9 = Tests::search_tests();
+                int t10 = Tests::qsearch_tests();
+                int t11 = Tests::analysis_tests();
 
                 std::cout << "\nTest summary" << std::endl;
                 std::cout << "  Perft:        " << t1 << " failed cases" << std::endl;
@@ -155,6 +295,71 @@ namespace UCI
                 std::cout << "  Orderer:      " << t3 << " failed cases" << std::endl;
                 std::cout << "  TT + Orderer: " << t4 << " failed cases" << std::endl;
                 std::cout << "  Legality:     " << t5 << " failed cases" << std::endl;
+                std::cout << "  Threats:      " << t6 << " failed cases" << std::endl;
+                std::cout << "  Hash keys:    " << t7 << " failed cases" << std::endl;
+                std::cout << "  Tasks:        " << t8 << " failed cases" << std::endl;
+                std::cout << "  Search:       " << t9 << " failed cases" << std::endl;
+                std::cout << "  QSearch:      " << t10 << " failed cases" << std::endl;
+                std::cout << "  Analysis:     " << t11 << " failed cases" << std::endl;
+            }
+            else if (token == "bench")
+            {
+                int depth = 12;
+                stream >> depth;
+                Tests::bench(depth);
+            }
+            else if (token == "scaling")
+            {
+                int movetime = 1000;
+                int max_threads = std::max(1u, std::thread::hardware_concurrency());
+                stream >> movetime >> max_threads;
+                Tests::scaling(movetime, max_threads);
+            }
+            else if (token == "analyzegame")
+                analyzegame(stream);
+            else if (token == "treelog")
+            {
+                // Arm a tree dump for the next search
+                std::string path;
+                int depth = NUM_MAX_DEPTH;
+                int ply = NUM_MAX_PLY;
+                stream >> path;
+                while (stream >> token)
+                    if (token == "depth")
+                        stream >> depth;
+                    else if (token == "ply")
+                        stream >> ply;
+                pool->log_next_search(path, std::clamp(depth, 1, static_cast<int>(NUM_MAX_DEPTH)), ply);
+            }
+            else if (token == "cluster")
+            {
+                // Distributed search: this process either coordinates workers or serves as one
+                std::string mode;
+                stream >> mode;
+                if (mode == "listen")
+                {
+                    int port = 0;
+                    stream >> port;
+                    if (!Cluster::listen(port))
+                        std::cout << "info string cannot listen on port " << port << std::endl;
+                }
+                else if (mode == "join")
+                {
+                    std::string host;
+                    int port = 0;
+                    stream >> host >> port;
+                    if (!Cluster::join(host, port))
+                        std::cout << "info string cannot join " << host << ":" << port << std::endl;
+                }
+                else
+                    Cluster::status(std::cout);
+            }
+            else if (token == "treestats")
+            {
+                std::string path;
+                stream >> path;
+                if (!TreeLog::report(path, std::cout))
+                    std::cout << "info string cannot read tree log " << path << std::endl;
             }
         }
     }
@@ -165,6 +370,8 @@ namespace UCI
     {
         std::cout << "id name hive" << std::endl;
         std::cout << "id author NULL" << std::endl;
+        std::cout << "info string " << CPU::description() << std::endl;
+        std::cout << "info string " << CPU::describe(CPU::resources()) << std::endl;
 
         // Send options
         std::cout << std::endl;
@@ -238,11 +445,26 @@ namespace UCI
         // Check if perft search
         if (perft_depth > 0)
         {
-            int64_t nodes = Search::perft<true>(pool->position(), perft_depth);
+            Perf::Counters counters;
+            bool measure = Options::PerfCounters;
+            if (measure)
+                counters.start();
+
+            int64_t nodes = Search::parallel_perft(*pool, pool->position(), perft_depth, true);
             std::cout << "\nNodes searched: " << nodes << std::endl;
+
+            if (measure)
+            {
+                counters.stop();
+                std::cout << "info string " << Perf::report(counters.read(), nodes, timer.elapsed()) << std::endl;
+            }
             return;
         }
 
+        // Cluster workers search the same root until the local search completes
+        if (Cluster::active())
+            Cluster::start_search(last_position, limits.searchmoves);
+
         pool->search(timer, limits);
     }
 
@@ -257,6 +479,7 @@ namespace UCI
 
     void quit(Stream& stream)
     {
+        Cluster::shutdown();
         pool->kill_threads();
     }
 
@@ -265,6 +488,7 @@ namespace UCI
     void position(Stream& stream)
     {
         Position& pos =  pool->position();
+        last_position = stream.str();
 
         std::string token;
         stream >> token;
@@ -309,7 +533,11 @@ namespace UCI
 
     void ucinewgame(Stream& stream)
     {
-        ttable.clear();
+        // Automatic options follow changes of the container limits between games
+        for (auto& [name, option] : OptionsMap)
+            option.refresh();
+
+        pool->clear();
     }
 
 
@@ -322,6 +550,88 @@ namespace UCI
 
 
 
+    void analyzegame(Stream& stream)
+    {
+        Search::Limits limits;
+        limits.depth = 0;
+        int jobs = 1;
+        std::vector<Analysis::Game> games;
+        Analysis::Game game{ "game", Position(), {} };
+
+        // Tokens ending a FEN or a move list are handled as the next keyword
+        const std::vector<std::string> keywords = { "startpos", "fen", "moves", "pgn", "depth", "nodes", "movetime", "jobs" };
+        auto is_keyword = [&](const std::string& token)
+        {
+            return std::find(keywords.begin(), keywords.end(), token) != keywords.end();
+        };
+
+        std::string token;
+        bool pending = false;
+        while (pending || stream >> token)
+        {
+            pending = false;
+            if (token == "startpos")
+                game.start = Position();
+            else if (token == "fen")
+            {
+                std::string fen;
+                while (stream >> token && !(pending = is_keyword(token)))
+                    fen += token + " ";
+                game.start = Position(fen);
+            }
+            else if (token == "moves")
+            {
+                Position position = game.start;
+                Move move;
+                while (stream >> token && !(pending = (move = move_from_uci(position, token)) == MOVE_NULL))
+                {
+                    game.moves.push_back(move);
+                    position.make_move(move);
+                    position.set_init_ply();
+                }
+            }
+            else if (token == "pgn")
+            {
+                std::string path;
+                stream >> path;
+                std::ifstream file(path);
+                if (!file)
+                {
+                    std::cout << "info string cannot open " << path << std::endl;
+                    return;
+                }
+                for (auto& pgn_game : Analysis::read_pgn(file))
+                    games.push_back(pgn_game);
+            }
+            else if (token == "depth")
+                stream >> limits.depth;
+            else if (token == "nodes")
+                stream >> limits.nodes;
+            else if (token == "movetime")
+                stream >> limits.movetime;
+            else if (token == "jobs")
+                stream >> jobs;
+        }
+
+        if (!game.moves.empty())
+            games.push_back(game);
+        if (games.empty())
+        {
+            std::cout << "info string no game to analyze" << std::endl;
+            return;
+        }
+
+        // Same default as bench when no limit is given
+        if (limits.depth == 0 && limits.movetime < 0 && limits.nodes == Search::Limits().nodes)
+            limits.depth = 12;
+        else if (limits.depth == 0)
+            limits.depth = Search::Limits().depth;
+
+        Analysis::analyze_games(games, limits, jobs);
+    }
+
+
+
     Move move_from_uci(Position& position, std::string move_str)
     {
         // Get moves for current position
@@ -334,4 +644,85 @@ namespace UCI
 
         return MOVE_NULL;
     }
+
+
+
+    Move move_from_san(Position& position, std::string move_str)
+    {
+        // Strip check, mate and annotation symbols
+        while (!move_str.empty() && std::strchr("+#!?", move_str.back()))
+            move_str.pop_back();
+
+        auto list = position.generate_moves(MoveGenType::LEGAL);
+
+        // Castling
+        if (move_str == "O-O" || move_str == "0-0" || move_str == "O-O-O" || move_str == "0-0-0")
+        {
+            bool king_side = move_str.size() == 3;
+            for (auto& move : list)
+                if (move.is_castle() && (move.to() > move.from()) == king_side)
+                    return move;
+            return MOVE_NULL;
+        }
+
+        // Promotion suffix, with or without the '=' separator
+        const char pieces[] = "PNBRQK";
+        PieceType promotion = PIECE_NONE;
+        std::size_t length = move_str.size();
+        if (length >= 3 && std::strchr("NBRQ", move_str.back()) && std::isdigit(move_str[length - 2]))
+        {
+            promotion = static_cast<PieceType>(std::strchr(pieces, move_str.back()) - pieces);
+            move_str.pop_back();
+        }
+        else if (length >= 4 && move_str[length - 2] == '=' && std::strchr("NBRQ", move_str.back()))
+        {
+            promotion = static_cast<PieceType>(std::strchr(pieces, move_str.back()) - pieces);
+            move_str.resize(length - 2);
+        }
+
+        // Moving piece, capture marker and destination square
+        PieceType piece = PAWN;
+        if (!move_str.empty() && std::strchr("NBRQK", move_str.front()))
+        {
+            piece = static_cast<PieceType>(std::strchr(pieces, move_str.front()) - pieces);
+            move_str.erase(0, 1);
+        }
+        move_str.erase(std::remove(move_str.begin(), move_str.end(), 'x'), move_str.end());
+        if (move_str.size() < 2 || move_str.size() > 4)
+            return MOVE_NULL;
+
+        std::string to = move_str.substr(move_str.size() - 2);
+        std::string from = move_str.substr(0, move_str.size() - 2);
+        if (to[0] < 'a' || to[0] > 'h' || to[1] < '1' || to[1] > '8')
+            return MOVE_NULL;
+        Square target = (to[1] - '1') * 8 + (to[0] - 'a');
+
+        // The remaining characters disambiguate the origin square, which must leave a single candidate
+        Move result = MOVE_NULL;
+        for (auto& move : list)
+        {
+            if (move.to() != target || position.board().get_piece_at(move.from()) != piece ||
+                move.is_promotion() != (promotion != PIECE_NONE) ||
+                (move.is_promotion() && move.promo_piece() != promotion))
+                continue;
+
+            bool matches = true;
+            for (char c : from)
+                if (c >= 'a' && c <= 'h')
+                    matches = matches && move.from() % 8 == c - 'a';
+                else if (c >= '1' && c <= '8')
+                    matches = matches && move.from() / 8 == c - '1';
+                else
+                    matches = false;
+
+            if (matches)
+            {
+                if (result != MOVE_NULL)
+                    return MOVE_NULL;
+                result = move;
+            }
+        }
+
+        return result;
+    }
 }